@@ -0,0 +1,51 @@
+#!/bin/sh
+# Cycle detection check for the gol-seq engines
+#
+# Usage: ./cycles.sh [gol-seq]
+#
+# Runs worlds that end in a cycle with every engine and compares the output,
+# the cycle found, its generation and the live cells, with the int engine.
+# The hashlife engine jumps over generations and detects no cycles, so it is
+# left out.
+
+seq=${1:-./gol-seq}
+engines="bits blocked active sparse auto"
+tmp=${TMPDIR:-/tmp}/cycles.$$
+status=0
+
+mkdir -p "$tmp" || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# a still block in column 1, which the border wrap also puts past the last column
+printf 'x = 2, y = 2\n2o$2o!\n' >"$tmp/block.rle"
+# a glider comes back after 4 * side generations on a square torus
+printf 'x = 3, y = 3\nbo$2bo$3o!\n' >"$tmp/glider.rle"
+
+check() {
+    "$seq" -e int "$@" 2>/dev/null >"$tmp/int" || { echo "FAIL int: $*"; status=1; return; }
+    grep -q "is equal to iteration" "$tmp/int" || { echo "FAIL int finds no cycle: $*"; status=1; }
+    for engine in $engines; do
+        if "$seq" -e "$engine" "$@" 2>/dev/null | cmp -s - "$tmp/int"; then
+            echo "ok   $engine: $*"
+        else
+            echo "FAIL $engine: $*"
+            status=1
+        fi
+    done
+}
+
+# column counts that are not a multiple of 64
+check 100 77 3000 0 0
+check -i "$tmp/block.rle" 10 100 50 0 0
+check -i "$tmp/block.rle" 10 128 50 0 0
+
+# periods 2 and 6, and periods longer than the history of full worlds
+check -s 3 200 200 4000 0 0
+check -i "$tmp/glider.rle" 20 20 500 0 0
+check -i "$tmp/glider.rle" 30 30 1000 0 0
+
+# fast forward after the cycle, with worlds printed on the way
+check -f 100 77 5000 0 13
+check -f -i "$tmp/glider.rle" 33 33 3000 0 100
+
+exit $status
@@ -0,0 +1,258 @@
+/***********************
+
+Fingerprint based cycle detection
+
+The fingerprint of a world is the sum over its live cells of
+cycle_row_keys[row] * cycle_col_keys[col], modulo 2^64. It is additive, so it
+is accumulated row by row while the time step writes the rows, and the
+fingerprints of partial worlds add up to the one of the whole world. The
+column keys have 23 bits, so the sum within a row is exact in the 32-bit
+lanes of row_sum in gol-simd.h.
+
+The fingerprints of the last ring_length generations are kept in a ring with
+an open addressing index, which finds a period up to ring_length in O(1) per
+generation. Longer periods are caught with Brent's algorithm: the fingerprint
+of a checkpoint generation is kept and the checkpoint moves forward at
+doubling distances.
+
+Equal fingerprints only make a candidate. Periods within the history of full
+worlds are compared right away, for longer ones the caller takes a snapshot
+and compares it one period later.
+
+************************/
+
+#ifndef GOL_CYCLE_H
+#define GOL_CYCLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gol-simd.h"
+
+static uint64_t *cycle_row_keys; // indexed from 1, like the cells
+static uint32_t *cycle_col_keys;
+
+static uint64_t
+cycle_mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void
+cycle_keys_init(int rows, int cols)
+{
+    int i;
+
+    cycle_row_keys = malloc((rows + 1) * sizeof(uint64_t));
+    cycle_col_keys = malloc((cols + 1) * sizeof(uint32_t));
+    if (cycle_row_keys == NULL || cycle_col_keys == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i <= rows; i++)
+    {
+        cycle_row_keys[i] = cycle_mix(i);
+    }
+    for (i = 0; i <= cols; i++)
+    {
+        cycle_col_keys[i] = cycle_mix(((uint64_t)1 << 32) + i) >> 41;
+    }
+}
+
+// fingerprint of n cells with values 0 or 1 of world row row,
+// starting at world column col
+static uint64_t
+cycle_row_fingerprint(int row, int col, const int *cells, int n)
+{
+    return row_sum(&cycle_col_keys[col], cells, n) * cycle_row_keys[row];
+}
+
+typedef struct
+{
+    int length;      // ring length, 0 to search the history only
+    uint64_t *ring;  // fingerprint of generation i in ring[i % length]
+    int *index;      // generation + 1 of a ring entry, 0 for an empty slot
+    int index_mask;
+    int first, last; // first and last generation recorded
+    int rebuilt;     // generation the index was last rebuilt at
+
+    uint64_t brent_fingerprint; // checkpoint of Brent's algorithm
+    int brent_iter, brent_power;
+
+    int pending_iter, pending_period; // candidate waiting for its full compare, period 0 if none
+} cycle_detector;
+
+static void
+cycle_detector_init(cycle_detector *d, int length)
+{
+    int nslots = 1;
+
+    // at most 2 * length entries between rebuilds, keep the index half full
+    while (nslots < 4 * length)
+    {
+        nslots *= 2;
+    }
+
+    d->length = length;
+    d->ring = malloc((length > 0 ? length : 1) * sizeof(uint64_t));
+    d->index = calloc(nslots, sizeof(int));
+    if (d->ring == NULL || d->index == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    d->index_mask = nslots - 1;
+    d->first = -1;
+    d->last = -1;
+    d->rebuilt = 0;
+    d->brent_iter = -1;
+    d->brent_power = length > 0 ? length : 1;
+    d->pending_period = 0;
+}
+
+// is generation i still in the ring?
+static int
+cycle_in_ring(cycle_detector *d, int i)
+{
+    return i >= d->first && i <= d->last && i > d->last - d->length;
+}
+
+static size_t
+cycle_slot(cycle_detector *d, uint64_t fingerprint)
+{
+    return (size_t)(fingerprint ^ (fingerprint >> 32)) & d->index_mask;
+}
+
+static void
+cycle_index_insert(cycle_detector *d, int iter, uint64_t fingerprint)
+{
+    size_t slot = cycle_slot(d, fingerprint);
+
+    // an entry with the same fingerprint is replaced by the more recent one
+    while (d->index[slot] != 0)
+    {
+        int i = d->index[slot] - 1;
+
+        if (cycle_in_ring(d, i) && d->ring[i % d->length] == fingerprint)
+        {
+            break;
+        }
+        slot = (slot + 1) & d->index_mask;
+    }
+    d->index[slot] = iter + 1;
+}
+
+// most recent generation before iter with the same fingerprint, -1 if none;
+// call it before cycle_detector_record for iter
+static int
+cycle_detector_find(cycle_detector *d, int iter, uint64_t fingerprint)
+{
+    size_t slot;
+
+    if (d->length == 0)
+    {
+        return -1;
+    }
+
+    for (slot = cycle_slot(d, fingerprint); d->index[slot] != 0; slot = (slot + 1) & d->index_mask)
+    {
+        int i = d->index[slot] - 1;
+
+        if (cycle_in_ring(d, i) && i < iter && d->ring[i % d->length] == fingerprint)
+        {
+            return i;
+        }
+    }
+
+    if (d->brent_iter >= 0 && d->brent_iter < iter && d->brent_fingerprint == fingerprint)
+    {
+        return d->brent_iter;
+    }
+
+    return -1;
+}
+
+// rebuild the index from the ring, which drops the entries that fell out of it
+static void
+cycle_detector_reindex(cycle_detector *d)
+{
+    int i;
+
+    memset(d->index, 0, (d->index_mask + 1) * sizeof(int));
+    for (i = d->last - d->length + 1 > d->first ? d->last - d->length + 1 : d->first; i <= d->last; i++)
+    {
+        cycle_index_insert(d, i, d->ring[i % d->length]);
+    }
+    d->rebuilt = d->last;
+}
+
+static void
+cycle_detector_record(cycle_detector *d, int iter, uint64_t fingerprint)
+{
+    if (d->length == 0)
+    {
+        return;
+    }
+
+    if (d->first < 0)
+    {
+        d->first = iter;
+        d->rebuilt = iter;
+    }
+    d->last = iter;
+    d->ring[iter % d->length] = fingerprint;
+
+    // drop the entries that fell out of the ring once per ring length
+    if (iter - d->rebuilt >= d->length)
+    {
+        cycle_detector_reindex(d);
+    }
+    else
+    {
+        cycle_index_insert(d, iter, fingerprint);
+    }
+
+    if (d->brent_iter < 0 || iter - d->brent_iter >= d->brent_power)
+    {
+        if (d->brent_iter >= 0 && d->brent_power <= INT32_MAX / 2)
+        {
+            d->brent_power *= 2;
+        }
+        d->brent_iter = iter;
+        d->brent_fingerprint = fingerprint;
+    }
+}
+
+// record generation iter, returns 1 if the caller has to take a snapshot of it
+// because it repeats a generation that is older than the history of full worlds
+static int
+cycle_detector_candidate(cycle_detector *d, int iter, uint64_t fingerprint, int history)
+{
+    int i = cycle_detector_find(d, iter, fingerprint);
+
+    cycle_detector_record(d, iter, fingerprint);
+    if (i < 0 || iter - i < history || d->pending_period != 0)
+    {
+        return 0;
+    }
+
+    d->pending_iter = iter;
+    d->pending_period = iter - i;
+    return 1;
+}
+
+// is the snapshot due to be compared with generation iter?
+static int
+cycle_detector_due(cycle_detector *d, int iter)
+{
+    return d->pending_period != 0 && iter == d->pending_iter + d->pending_period;
+}
+
+#endif
@@ -11,6 +11,11 @@ Based on https://web.cs.dal.ca/~arc/teaching/CS4125/2014winter/Assignment2/Assig
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+
+#include "gol-render.h"
+#include "gol-rng.h"
+#include "gol-simd.h"
 
 int rank, size;
 
@@ -25,6 +30,7 @@ typedef struct
 {
     int rows, cols;
     int **cells;
+    int live; // number of live interior cells
 } partial_world;
 
 /* keep short history since we want to detect simple cycles */
@@ -43,6 +49,10 @@ static int partial_world_rows, partial_world_cols; // number of rows and columns
 static int partial_world_start, partial_world_end; // start and end row of the partial world
 static partial_world *cur_partial_world;           // current partial world
 
+// ghost depth, the ranks exchange this many rows at once and then advance as
+// many generations, recomputing a shrinking border of ghost rows
+static int halo_depth = 1;
+
 // use fixed world or random world?
 #ifdef FIXED_WORLD
 static int random_world = 0;
@@ -106,83 +116,74 @@ static void
 world_init_random(world *world)
 {
     int **cells = world->cells;
-    int row, col;
-
-    // Note that rand() implementation is platform dependent.
-    // At least make it reprodible on this platform by means of srand()
-    srand(1);
+    int row;
 
+    // the same world as gol-seq and gol-par, see gol-rng.h
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            float x = rand() / ((float)RAND_MAX + 1);
-            if (x < 0.5)
-            {
-                cells[row][col] = 0;
-            }
-            else
-            {
-                cells[row][col] = 1;
-            }
-        }
+        rng_row(&cells[row][1], (uint64_t)(row - 1) * world->cols, world->cols);
     }
 }
 
 static void
 world_print(world *world)
 {
-    int **cells = world->cells;
-    int row, col;
+    int row;
 
+    render_begin(world->rows, world->cols);
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            if (cells[row][col])
-            {
-                printf("O");
-            }
-            else
-            {
-                printf(" ");
-            }
-        }
-        printf("\n");
+        render_row(&world->cells[row][1]);
     }
+    render_end();
 }
 
 static int
-world_count(world *world)
+partial_world_count(partial_world *partial_world)
 {
-    int **cells = world->cells;
-    int isum;
-    int row, col;
+    int live = 0;
 
-    isum = 0;
-    for (row = 1; row <= world->rows; row++)
-    {
-        for (col = 1; col <= world->cols; col++)
-        {
-            isum = isum + cells[row][col];
-        }
-    }
+    for (int row = 1; row <= partial_world->rows; row++)
+        live += row_count(&partial_world->cells[row][1], partial_world->cols);
+
+    return live;
+}
+
+// advance one row of the partial world, the live count of the interior rows
+// is taken while the new row is in cache
+static void
+partial_world_row_step(partial_world *old, partial_world *new, int row)
+{
+    int **cells = old->cells;
 
-    return isum;
+    row_step(&cells[row - 1][1], &cells[row][1], &cells[row + 1][1], &new->cells[row][1], new->cols);
+    if (row >= 1 && row <= new->rows)
+        new->live += row_count(&new->cells[row][1], new->cols);
 }
 
 // caculate the next state of the partial world
+// extra is the number of ghost rows on each side that are still valid in old,
+// the ghost rows are exchanged when it drops to zero
 static void
-partial_world_timestep_latency_hiding(partial_world *old, partial_world *new)
+partial_world_timestep_latency_hiding(partial_world *old, partial_world *new, int extra)
 {
     int **cells = old->cells;
+    int k = halo_depth;
 
-    for (int row = 1; row <= old->rows; row++)
+    new->live = 0;
+    for (int row = 1 - extra; row <= old->rows + extra; row++)
     {
         cells[row][0] = cells[row][old->cols];
         cells[row][old->cols + 1] = cells[row][1];
     }
 
+    if (extra > 0)
+    {
+        for (int row = 2 - extra; row < new->rows + extra; ++row)
+            partial_world_row_step(old, new, row);
+        return;
+    }
+
     int target_rank1 = rank - 1;
     int target_rank2 = rank + 1;
     if (target_rank1 < 0)
@@ -190,101 +191,27 @@ partial_world_timestep_latency_hiding(partial_world *old, partial_world *new)
     if (target_rank2 >= size)
         target_rank2 = 0;
 
+    // k rows including their ghost columns are contiguous
     MPI_Request request1, request2, request3, request4;
-    MPI_Isend(&cells[1][0], old->cols + 2, MPI_INT, target_rank1, 0, MPI_COMM_WORLD, &request1);
-    MPI_Isend(&cells[old->rows][0], old->cols + 2, MPI_INT, target_rank2, 1, MPI_COMM_WORLD, &request2);
-    MPI_Irecv(&cells[0][0], old->cols + 2, MPI_INT, target_rank1, 1, MPI_COMM_WORLD, &request3);
-    MPI_Irecv(&cells[old->rows + 1][0], old->cols + 2, MPI_INT, target_rank2, 0, MPI_COMM_WORLD, &request4);
+    MPI_Isend(&cells[1][0], k * (old->cols + 2), MPI_INT, target_rank1, 0, MPI_COMM_WORLD, &request1);
+    MPI_Isend(&cells[old->rows - k + 1][0], k * (old->cols + 2), MPI_INT, target_rank2, 1, MPI_COMM_WORLD, &request2);
+    MPI_Irecv(&cells[1 - k][0], k * (old->cols + 2), MPI_INT, target_rank1, 1, MPI_COMM_WORLD, &request3);
+    MPI_Irecv(&cells[old->rows + 1][0], k * (old->cols + 2), MPI_INT, target_rank2, 0, MPI_COMM_WORLD, &request4);
 
     for (int row = 2; row < new->rows; ++row)
-        for (int col = 1; col <= new->cols; ++col)
-        {
-            int row_m, row_p, col_m, col_p, nsum;
-            int newval;
-
-            row_m = row - 1;
-            row_p = row + 1;
-            col_m = col - 1;
-            col_p = col + 1;
-
-            nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[row][col_m] + cells[row][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
-
-            switch (nsum)
-            {
-            case 3:
-                newval = 1;
-                break;
-            case 2:
-                newval = cells[row][col];
-                break;
-            default:
-                newval = 0;
-                break;
-            }
-
-            new->cells[row][col] = newval;
-        }
+        partial_world_row_step(old, new, row);
 
     MPI_Wait(&request1, MPI_STATUS_IGNORE);
     MPI_Wait(&request2, MPI_STATUS_IGNORE);
     MPI_Wait(&request3, MPI_STATUS_IGNORE);
     MPI_Wait(&request4, MPI_STATUS_IGNORE);
 
-    for (int col = 1; col <= new->cols; ++col)
-    {
-        int row_m, row_p, col_m, col_p, nsum;
-        int newval;
-
-        row_m = 0;
-        row_p = 2;
-        col_m = col - 1;
-        col_p = col + 1;
-
-        nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[1][col_m] + cells[1][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
-
-        switch (nsum)
-        {
-        case 3:
-            newval = 1;
-            break;
-        case 2:
-            newval = cells[1][col];
-            break;
-        default:
-            newval = 0;
-            break;
-        }
-
-        new->cells[1][col] = newval;
-    }
-
-    for (int col = 1; col <= new->cols; ++col)
-    {
-        int row_m, row_p, col_m, col_p, nsum;
-        int newval;
-
-        row_m = new->rows - 1;
-        row_p = new->rows + 1;
-        col_m = col - 1;
-        col_p = col + 1;
-
-        nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[new->rows][col_m] + cells[new->rows][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
-
-        switch (nsum)
-        {
-        case 3:
-            newval = 1;
-            break;
-        case 2:
-            newval = cells[new->rows][col];
-            break;
-        default:
-            newval = 0;
-            break;
-        }
-
-        new->cells[new->rows][col] = newval;
-    }
+    // the border rows need the ghost rows that have just arrived, the k - 1
+    // outer ones of them are advanced as well for the next generations
+    for (int row = 2 - k; row <= 1; ++row)
+        partial_world_row_step(old, new, row);
+    for (int row = new->rows; row < new->rows + k; ++row)
+        partial_world_row_step(old, new, row);
 }
 
 // check if the partial world is in a cycle
@@ -338,6 +265,13 @@ alloc_2d_int_array(int nrows, int ncolumns)
     return array;
 }
 
+// partial world with halo ghost rows on each side, indexed from 1 - halo to rows + halo
+static int **
+alloc_partial_world_cells(int rows, int cols, int halo)
+{
+    return alloc_2d_int_array(rows + 2 * halo, cols + 2) + halo - 1;
+}
+
 static double
 time_secs(void)
 {
@@ -352,21 +286,46 @@ time_secs(void)
     return tv.tv_sec + (tv.tv_usec / 1000000.0);
 }
 
-// rank0 collects the partial worlds from other ranks
+// rank0 gathers the interior rows of all partial worlds straight into the
+// world, one block of rows per rank placed at its start row
+static MPI_Datatype row_type; // interior cells of a row, strided like the rows
+static int *gather_counts, *gather_displs;
+
 static void
-collect_world(void)
+collect_world_init(void)
 {
-    if (rank != 0)
-        for (int i = 1; i <= partial_world_rows; i++)
-            MPI_Send(&cur_partial_world->cells[i][1], partial_world_cols, MPI_INT, 0, i + partial_world_start, MPI_COMM_WORLD);
-    else
+    MPI_Datatype row_cells;
+
+    MPI_Type_contiguous(world_cols, MPI_INT, &row_cells);
+    MPI_Type_create_resized(row_cells, 0, (world_cols + 2) * sizeof(int), &row_type);
+    MPI_Type_commit(&row_type);
+    MPI_Type_free(&row_cells);
+
+    gather_counts = malloc(size * sizeof(int));
+    gather_displs = malloc(size * sizeof(int));
+    if (gather_counts == NULL || gather_displs == NULL)
     {
-        for (int i = 1; i <= partial_world_rows; i++)
-            for (int j = 1; j <= partial_world_cols; j++)
-                cur_world->cells[i + partial_world_start][j] = cur_partial_world->cells[i][j];
-        for (int i = 1 + partial_world_rows; i <= world_rows; i++)
-            MPI_Recv(&cur_world->cells[i][1], partial_world_cols, MPI_INT, MPI_ANY_SOURCE, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        fprintf(stderr, "out of memory\n");
+        exit(1);
     }
+    MPI_Gather(&partial_world_rows, 1, MPI_INT, gather_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&partial_world_start, 1, MPI_INT, gather_displs, 1, MPI_INT, 0, MPI_COMM_WORLD);
+}
+
+static void
+collect_world(void)
+{
+    MPI_Gatherv(&cur_partial_world->cells[1][1], partial_world_rows, row_type,
+                &cur_world->cells[1][1], gather_counts, gather_displs, row_type, 0, MPI_COMM_WORLD);
+}
+
+static void
+usage(char *prog)
+{
+    if (rank == 0)
+        fprintf(stderr, "Usage: %s [-k auto|scalar|sse2|avx2|avx512] [-d depth] [-s seed] [-p probability] [-z scale] [-F frames] rows cols steps worldstep cellstep\n", prog);
+    MPI_Finalize();
+    exit(1);
 }
 
 int main(int argc, char *argv[])
@@ -375,20 +334,64 @@ int main(int argc, char *argv[])
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    int h, nsteps;
+    int h, nsteps, opt;
     double start_time, end_time, elapsed_time;
+    const char *kernel = "auto";
 
     /* Get Parameters */
-    if (argc != 6)
+    while ((opt = getopt(argc, argv, "k:d:s:p:z:F:")) != -1)
     {
-        fprintf(stderr, "Usage: %s rows cols steps worldstep cellstep\n", argv[0]);
-        exit(1);
+        switch (opt)
+        {
+        case 'k':
+            kernel = optarg;
+            break;
+        case 's':
+            rng_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            rng_density = atof(optarg);
+            break;
+        case 'z':
+            render_scale = atoi(optarg);
+            if (render_scale < 1)
+                usage(argv[0]);
+            break;
+        case 'F':
+            render_frames = optarg;
+            if (!render_frames_check(render_frames))
+                usage(argv[0]);
+            break;
+        case 'd':
+            halo_depth = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
-    world_rows = atoi(argv[1]);
-    world_cols = atoi(argv[2]);
-    nsteps = atoi(argv[3]);
-    print_world = atoi(argv[4]);
-    print_cells = atoi(argv[5]);
+    if (argc - optind != 5)
+    {
+        usage(argv[0]);
+    }
+    world_rows = atoi(argv[optind]);
+    world_cols = atoi(argv[optind + 1]);
+    nsteps = atoi(argv[optind + 2]);
+    print_world = atoi(argv[optind + 3]);
+    print_cells = atoi(argv[optind + 4]);
+
+    if (row_step_select(kernel) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // every partial world has to provide the halo of its neighbours
+    if (halo_depth < 1 || halo_depth > world_rows / size)
+    {
+        if (rank == 0)
+            fprintf(stderr, "ghost depth %d does not fit partial worlds of %d rows\n", halo_depth, world_rows / size);
+        usage(argv[0]);
+    }
+
+    rng_init();
 
     // initialize the world
     cur_world = (world *)malloc(sizeof(world));
@@ -443,10 +446,11 @@ int main(int argc, char *argv[])
     {
         partial_worlds[h].rows = partial_world_rows;
         partial_worlds[h].cols = partial_world_cols;
-        partial_worlds[h].cells = alloc_2d_int_array(partial_world_rows + 2, partial_world_cols + 2);
+        partial_worlds[h].cells = alloc_partial_world_cells(partial_world_rows, partial_world_cols, halo_depth);
     }
 
     cur_partial_world = &partial_worlds[world_iter % HISTORY];
+    collect_world_init();
 
     // use the received world to initialize the partial world
     for (int i = 1; i <= partial_world_rows; i++)
@@ -456,6 +460,7 @@ int main(int argc, char *argv[])
             cur_partial_world->cells[i][j] = cur_world->cells[i + partial_world_start][j];
         }
     }
+    cur_partial_world->live = partial_world_count(cur_partial_world);
 
     if (rank == 0)
         start_time = time_secs();
@@ -464,7 +469,7 @@ int main(int argc, char *argv[])
     for (world_iter = 1; world_iter < nsteps; world_iter++)
     {
         partial_world *next_partial_world = &partial_worlds[world_iter % HISTORY];
-        partial_world_timestep_latency_hiding(cur_partial_world, next_partial_world);
+        partial_world_timestep_latency_hiding(cur_partial_world, next_partial_world, (halo_depth - (world_iter - 1) % halo_depth) % halo_depth);
         cur_partial_world = next_partial_world;
 
         int cycle = partial_world_check_cycles_latency_hiding(cur_partial_world, world_iter);
@@ -483,11 +488,14 @@ int main(int argc, char *argv[])
                 printf("world iteration %d is equal to iteration %d\n", world_iter, cycle);
         }
 
+        // the live counts come from the time step, only they are reduced
         if (print_cells > 0 && (world_iter % print_cells) == (print_cells - 1))
         {
-            collect_world();
+            int live;
+
+            MPI_Reduce(&cur_partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
             if (rank == 0)
-                printf("%d: %d live cells\n", world_iter, world_count(cur_world));
+                printf("%d: %d live cells\n", world_iter, live);
         }
 
         if (print_world > 0 && (world_iter % print_world) == (print_world - 1))
@@ -533,15 +541,18 @@ int main(int argc, char *argv[])
         elapsed_time = end_time - start_time;
     }
 
-    collect_world();
+    /*  Iterations are done; sum the number of live cells */
+    int live;
+    MPI_Reduce(&cur_partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
 
     if (rank == 0)
     {
-        /*  Iterations are done; sum the number of live cells */
-        printf("Number of live cells = %d\n", world_count(cur_world));
+        printf("Number of live cells = %d\n", live);
         fprintf(stderr, "Game of Life took %10.3f seconds\n", elapsed_time);
+        fprintf(stderr, "step kernel: %s\n", row_step_name);
     }
 
+    MPI_Type_free(&row_type);
     MPI_Finalize();
 
     return 0;
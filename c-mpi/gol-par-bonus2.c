@@ -11,6 +11,11 @@ Based on https://web.cs.dal.ca/~arc/teaching/CS4125/2014winter/Assignment2/Assig
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+
+#include "gol-render.h"
+#include "gol-rng.h"
+#include "gol-simd.h"
 
 int rank, size;
 
@@ -25,6 +30,7 @@ typedef struct
 {
     int rows, cols;
     int **cells;
+    int live; // number of live interior cells
 } partial_world;
 
 /* keep short history since we want to detect simple cycles */
@@ -109,69 +115,37 @@ static void
 world_init_random(world *world)
 {
     int **cells = world->cells;
-    int row, col;
-
-    // Note that rand() implementation is platform dependent.
-    // At least make it reprodible on this platform by means of srand()
-    srand(1);
+    int row;
 
+    // the same world as gol-seq and gol-par, see gol-rng.h
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            float x = rand() / ((float)RAND_MAX + 1);
-            if (x < 0.5)
-            {
-                cells[row][col] = 0;
-            }
-            else
-            {
-                cells[row][col] = 1;
-            }
-        }
+        rng_row(&cells[row][1], (uint64_t)(row - 1) * world->cols, world->cols);
     }
 }
 
 static void
 world_print(world *world)
 {
-    int **cells = world->cells;
-    int row, col;
+    int row;
 
+    render_begin(world->rows, world->cols);
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            if (cells[row][col])
-            {
-                printf("O");
-            }
-            else
-            {
-                printf(" ");
-            }
-        }
-        printf("\n");
+        render_row(&world->cells[row][1]);
     }
+    render_end();
 }
 
 static int
-world_count(world *world)
+partial_world_count(partial_world *partial_world)
 {
-    int **cells = world->cells;
-    int isum;
-    int row, col;
+    int live = 0;
 
-    isum = 0;
-    for (row = 1; row <= world->rows; row++)
-    {
-        for (col = 1; col <= world->cols; col++)
-        {
-            isum = isum + cells[row][col];
-        }
-    }
+    for (int row = 1; row <= partial_world->rows; row++)
+        live += row_count(&partial_world->cells[row][1], partial_world->cols);
 
-    return isum;
+    return live;
 }
 
 // fill ghost cells through MPI
@@ -216,35 +190,14 @@ partial_world_timestep(partial_world *old, partial_world *new)
 
     int **cells = old->cells;
 
+    // the live count is taken while the new row is in cache
+    new->live = 0;
     for (int row = 1; row <= new->rows; ++row)
-        for (int col = 1; col <= new->cols; ++col)
-        {
-            int row_m, row_p, col_m, col_p, nsum;
-            int newval;
-
-            row_m = row - 1;
-            row_p = row + 1;
-            col_m = col - 1;
-            col_p = col + 1;
-
-            nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[row][col_m] + cells[row][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
-
-            switch (nsum)
-            {
-            case 3:
-                newval = 1;
-                break;
-            case 2:
-                newval = cells[row][col];
-                break;
-            default:
-                newval = 0;
-                break;
-            }
+    {
+        row_step(&cells[row - 1][1], &cells[row][1], &cells[row + 1][1], &new->cells[row][1], new->cols);
+        new->live += row_count(&new->cells[row][1], new->cols);
+    }
 
-            new->cells[row][col] = newval;
-        }
-    
     computation_time += MPI_Wtime() - start_time;
 }
 
@@ -308,21 +261,46 @@ time_secs(void)
     return tv.tv_sec + (tv.tv_usec / 1000000.0);
 }
 
-// rank0 collects the partial worlds from other ranks
+// rank0 gathers the interior rows of all partial worlds straight into the
+// world, one block of rows per rank placed at its start row
+static MPI_Datatype row_type; // interior cells of a row, strided like the rows
+static int *gather_counts, *gather_displs;
+
 static void
-collect_world(void)
+collect_world_init(void)
 {
-    if (rank != 0)
-        for (int i = 1; i <= partial_world_rows; i++)
-            MPI_Send(&cur_partial_world->cells[i][1], partial_world_cols, MPI_INT, 0, i + partial_world_start, MPI_COMM_WORLD);
-    else
+    MPI_Datatype row_cells;
+
+    MPI_Type_contiguous(world_cols, MPI_INT, &row_cells);
+    MPI_Type_create_resized(row_cells, 0, (world_cols + 2) * sizeof(int), &row_type);
+    MPI_Type_commit(&row_type);
+    MPI_Type_free(&row_cells);
+
+    gather_counts = malloc(size * sizeof(int));
+    gather_displs = malloc(size * sizeof(int));
+    if (gather_counts == NULL || gather_displs == NULL)
     {
-        for (int i = 1; i <= partial_world_rows; i++)
-            for (int j = 1; j <= partial_world_cols; j++)
-                cur_world->cells[i + partial_world_start][j] = cur_partial_world->cells[i][j];
-        for (int i = 1 + partial_world_rows; i <= world_rows; i++)
-            MPI_Recv(&cur_world->cells[i][1], partial_world_cols, MPI_INT, MPI_ANY_SOURCE, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        fprintf(stderr, "out of memory\n");
+        exit(1);
     }
+    MPI_Gather(&partial_world_rows, 1, MPI_INT, gather_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Gather(&partial_world_start, 1, MPI_INT, gather_displs, 1, MPI_INT, 0, MPI_COMM_WORLD);
+}
+
+static void
+collect_world(void)
+{
+    MPI_Gatherv(&cur_partial_world->cells[1][1], partial_world_rows, row_type,
+                &cur_world->cells[1][1], gather_counts, gather_displs, row_type, 0, MPI_COMM_WORLD);
+}
+
+static void
+usage(char *prog)
+{
+    if (rank == 0)
+        fprintf(stderr, "Usage: %s [-k auto|scalar|sse2|avx2|avx512] [-s seed] [-p probability] [-z scale] [-F frames] rows cols steps worldstep cellstep\n", prog);
+    MPI_Finalize();
+    exit(1);
 }
 
 int main(int argc, char *argv[])
@@ -331,20 +309,54 @@ int main(int argc, char *argv[])
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    int h, nsteps;
+    int h, nsteps, opt;
     double start_time, end_time, elapsed_time;
+    const char *kernel = "auto";
 
     /* Get Parameters */
-    if (argc != 6)
+    while ((opt = getopt(argc, argv, "k:s:p:z:F:")) != -1)
     {
-        fprintf(stderr, "Usage: %s rows cols steps worldstep cellstep\n", argv[0]);
-        exit(1);
+        switch (opt)
+        {
+        case 'k':
+            kernel = optarg;
+            break;
+        case 's':
+            rng_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            rng_density = atof(optarg);
+            break;
+        case 'z':
+            render_scale = atoi(optarg);
+            if (render_scale < 1)
+                usage(argv[0]);
+            break;
+        case 'F':
+            render_frames = optarg;
+            if (!render_frames_check(render_frames))
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 5)
+    {
+        usage(argv[0]);
     }
-    world_rows = atoi(argv[1]);
-    world_cols = atoi(argv[2]);
-    nsteps = atoi(argv[3]);
-    print_world = atoi(argv[4]);
-    print_cells = atoi(argv[5]);
+    world_rows = atoi(argv[optind]);
+    world_cols = atoi(argv[optind + 1]);
+    nsteps = atoi(argv[optind + 2]);
+    print_world = atoi(argv[optind + 3]);
+    print_cells = atoi(argv[optind + 4]);
+
+    if (row_step_select(kernel) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    rng_init();
 
     // initialize the world
     cur_world = (world *)malloc(sizeof(world));
@@ -403,6 +415,7 @@ int main(int argc, char *argv[])
     }
 
     cur_partial_world = &partial_worlds[world_iter % HISTORY];
+    collect_world_init();
 
     // use the received world to initialize the partial world
     for (int i = 1; i <= partial_world_rows; i++)
@@ -412,6 +425,7 @@ int main(int argc, char *argv[])
             cur_partial_world->cells[i][j] = cur_world->cells[i + partial_world_start][j];
         }
     }
+    cur_partial_world->live = partial_world_count(cur_partial_world);
 
     if (rank == 0)
         start_time = time_secs();
@@ -442,11 +456,14 @@ int main(int argc, char *argv[])
                 printf("world iteration %d is equal to iteration %d\n", world_iter, cycle);
         }
 
+        // the live counts come from the time step, only they are reduced
         if (print_cells > 0 && (world_iter % print_cells) == (print_cells - 1))
         {
-            collect_world();
+            int live;
+
+            MPI_Reduce(&cur_partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
             if (rank == 0)
-                printf("%d: %d live cells\n", world_iter, world_count(cur_world));
+                printf("%d: %d live cells\n", world_iter, live);
         }
 
         if (print_world > 0 && (world_iter % print_world) == (print_world - 1))
@@ -508,15 +525,18 @@ int main(int argc, char *argv[])
         elapsed_time = end_time - start_time;
     }
 
-    collect_world();
+    /*  Iterations are done; sum the number of live cells */
+    int live;
+    MPI_Reduce(&cur_partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
 
     if (rank == 0)
     {
-        /*  Iterations are done; sum the number of live cells */
-        printf("Number of live cells = %d\n", world_count(cur_world));
+        printf("Number of live cells = %d\n", live);
         fprintf(stderr, "Game of Life took %10.3f seconds\n", elapsed_time);
+        fprintf(stderr, "step kernel: %s\n", row_step_name);
     }
 
+    MPI_Type_free(&row_type);
     MPI_Finalize();
 
     return 0;
@@ -6,11 +6,25 @@ Based on https://web.cs.dal.ca/~arc/teaching/CS4125/2014winter/Assignment2/Assig
 
 ************************/
 
+#include <limits.h>
 #include <mpi.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gol-cycle.h"
+#include "gol-pattern.h"
+#include "gol-render.h"
+#include "gol-rng.h"
+#include "gol-simd.h"
+#include "gol-stream.h"
 
 int rank, size;
 
@@ -25,6 +39,8 @@ typedef struct
 {
     int rows, cols;
     int **cells;
+    uint64_t fingerprint; // of the interior cells, see gol-cycle.h
+    int live;             // number of live interior cells
 } partial_world;
 
 /* keep short history since we want to detect simple cycles */
@@ -33,16 +49,56 @@ typedef struct
 static int world_iter = 0;
 static int world_rows, world_cols;
 
-static world *cur_world;
+static world *cur_world; // whole world, only on rank0 and only for print_world
 
 static int print_cells = 0;
 static int print_world = 0;
+static int async_output = 0; // -a, worlds are written by a thread on rank0
 
 static partial_world partial_worlds[HISTORY];      // HISTORY partial worlds
 static int partial_world_rows, partial_world_cols; // number of rows and columns of the partial world
 static int partial_world_start, partial_world_end; // start and end row of the partial world
+static int partial_world_col_start, partial_world_col_end; // start and end column of the partial world
 static partial_world *cur_partial_world;           // current partial world
 
+// 2D process grid, periodic in both directions like the world
+static MPI_Comm cart_comm;
+static int dims[2], coords[2];
+static int north, south, west, east; // neighbouring ranks
+static MPI_Datatype column_type;     // halo_depth interior columns of a partial world
+
+// periods beyond HISTORY are found by the fingerprint of the whole world and
+// confirmed against a snapshot one period later
+static cycle_detector cycles;
+static int cycle_ring = 4096;
+static int **cycle_snapshot;
+
+// with -f a cycle does not end the run, the generations left are reduced
+// modulo the period and only those are replayed
+static int fast_forward = 0;
+
+// -c writes a checkpoint every -C generations and at the end, -r restarts from one
+static const char *checkpoint_file;
+static int checkpoint_every = 0;
+static const char *restart_file;
+
+// -o records every generation to a stream file, with a keyframe every -K
+// generations; every rank finds the runs of flipped cells in its block and
+// rank0 gathers and writes only those, so the traffic follows the activity
+static const char *stream_file;
+static int stream_key_every = 100;
+static int stream_last = -1;               // generation recorded last
+static stream_writer stream;               // on rank0
+static uint64_t *stream_runs;              // start and length of the runs of this rank
+static size_t stream_runs_capacity;
+static uint64_t *stream_all_runs;          // runs of all ranks, on rank0
+static size_t stream_all_capacity;
+static int *stream_counts, *stream_displs; // on rank0
+
+// ghost depth, the ranks exchange this many rows and columns at once and then
+// advance as many generations, recomputing a shrinking border of ghost cells
+static int halo_depth = 1;
+
 // use fixed world or random world?
 #ifdef FIXED_WORLD
 static int random_world = 0;
@@ -50,6 +106,9 @@ static int random_world = 0;
 static int random_world = 1;
 #endif
 
+// a pattern file given with -i replaces the random or fixed world
+static pattern start_pattern;
+
 static char *start_world[] = {
     /* Gosper glider gun */
     /* example from https://bitstorm.org/gameoflife/ */
@@ -78,418 +137,1976 @@ static char *start_world[] = {
 };
 
 static void
-world_init_fixed(world *world)
+world_print(world *world)
 {
-    int **cells = world->cells;
-    int row, col;
-
-    /* use predefined start_world */
+    int row;
 
+    render_begin(world->rows, world->cols);
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            if ((row <= sizeof(start_world) / sizeof(char *)) &&
-                (col <= strlen(start_world[row - 1])))
-            {
-                cells[row][col] = (start_world[row - 1][col - 1] != '.');
-            }
-            else
-            {
-                cells[row][col] = 0;
-            }
-        }
+        render_row(&world->cells[row][1]);
     }
+    render_end();
 }
 
+// split n rows or columns over parts blocks, the first n % parts blocks get one more
 static void
-world_init_random(world *world)
+split_range(int n, int parts, int index, int *start, int *count)
 {
-    int **cells = world->cells;
-    int row, col;
+    int quotient = n / parts;
+    int remainder = n % parts;
 
-    // Note that rand() implementation is platform dependent.
-    // At least make it reprodible on this platform by means of srand()
-    srand(1);
-
-    for (row = 1; row <= world->rows; row++)
+    if (index < remainder)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            float x = rand() / ((float)RAND_MAX + 1);
-            if (x < 0.5)
-            {
-                cells[row][col] = 0;
-            }
-            else
-            {
-                cells[row][col] = 1;
-            }
-        }
+        *count = quotient + 1;
+        *start = index * (quotient + 1);
+    }
+    else
+    {
+        *count = quotient;
+        *start = remainder * (quotient + 1) + (index - remainder) * quotient;
     }
 }
 
+// process grid with the least halo per rank, blocks of at least one cell if possible
 static void
-world_print(world *world)
+choose_dims(int nprocs, int rows, int cols, int dims[2])
 {
-    int **cells = world->cells;
-    int row, col;
+    double best_halo = 0;
+    int best_fits = -1;
 
-    for (row = 1; row <= world->rows; row++)
+    for (int prows = 1; prows <= nprocs; prows++)
     {
-        for (col = 1; col <= world->cols; col++)
+        if (nprocs % prows != 0)
+            continue;
+
+        int pcols = nprocs / prows;
+        int fits = prows <= rows && pcols <= cols;
+        double halo = (double)rows / prows + (double)cols / pcols;
+
+        if (fits > best_fits || (fits == best_fits && halo < best_halo))
         {
-            if (cells[row][col])
-            {
-                printf("O");
-            }
-            else
-            {
-                printf(" ");
-            }
+            dims[0] = prows;
+            dims[1] = pcols;
+            best_fits = fits;
+            best_halo = halo;
         }
-        printf("\n");
     }
 }
 
-static int
-world_count(world *world)
+// row pointers for nrows x ncolumns cells at data
+static int **
+make_2d_int_array(int *data, int nrows, int ncolumns)
 {
-    int **cells = world->cells;
-    int isum;
-    int row, col;
+    int **array;
+    int row;
 
-    isum = 0;
-    for (row = 1; row <= world->rows; row++)
+    array = malloc(nrows * sizeof(int *));
+    if (array == NULL)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            isum = isum + cells[row][col];
-        }
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* memory layout is row-major */
+    for (row = 0; row < nrows; row++)
+    {
+        array[row] = data + (size_t)row * ncolumns;
+    }
+
+    /* first touch by the threads that will work on the rows */
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < nrows; row++)
+        memset(array[row], 0, ncolumns * sizeof(int));
+
+    return array;
+}
+
+static int **
+alloc_2d_int_array(int nrows, int ncolumns)
+{
+    int *data;
+
+    /* version that keeps the 2d data contiguous, can help caching and slicing across dimensions */
+    data = malloc((size_t)nrows * ncolumns * sizeof(int));
+    if (data == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
     }
 
-    return isum;
+    return make_2d_int_array(data, nrows, ncolumns);
+}
+
+// partial world with halo ghost cells on each side, indexed from 1 - halo
+// to rows + halo and from 1 - halo to cols + halo
+static int **
+shift_partial_world_cells(int **array, int rows, int halo)
+{
+    for (int row = 0; row < rows + 2 * halo; row++)
+        array[row] += halo - 1;
+
+    return array + halo - 1;
+}
+
+static int **
+alloc_partial_world_cells(int rows, int cols, int halo)
+{
+    return shift_partial_world_cells(alloc_2d_int_array(rows + 2 * halo, cols + 2 * halo), rows, halo);
 }
 
-// fill ghost cells through MPI
+// copy the ghost columns within the rank when it is its own west and east neighbour
 static void
-partial_world_border_wrap(partial_world *partial_world)
+partial_world_wrap_columns(partial_world *partial_world)
 {
     int **cells = partial_world->cells;
+    int k = halo_depth;
 
+#pragma omp parallel for schedule(static)
     for (int row = 1; row <= partial_world->rows; row++)
     {
-        cells[row][0] = cells[row][partial_world->cols];
-        cells[row][partial_world->cols + 1] = cells[row][1];
+        for (int j = 0; j < k; j++)
+        {
+            cells[row][1 - k + j] = cells[row][partial_world->cols - k + 1 + j];
+            cells[row][partial_world->cols + 1 + j] = cells[row][1 + j];
+        }
     }
+}
+
+// copy the ghost rows within the rank when it is its own north and south
+// neighbour, after the ghost columns so that the corners come along
+static void
+partial_world_wrap_rows(partial_world *partial_world)
+{
+    int **cells = partial_world->cells;
+    int k = halo_depth;
+    int count = k * (partial_world->cols + 2 * k);
+
+    memcpy(&cells[1 - k][1 - k], &cells[partial_world->rows - k + 1][1 - k], count * sizeof(int));
+    memcpy(&cells[partial_world->rows + 1][1 - k], &cells[1][1 - k], count * sizeof(int));
+}
+
+/* Halo exchange backends
+ *
+ * All of them fill halo_depth ghost cells on each side. The columns go first,
+ * the rows then include the ghost columns, which fills the corners without
+ * messages to the diagonal neighbours.
+ */
+
+typedef struct
+{
+    const char *name;
+    int **(*alloc)(int h, int rows, int cols, int halo); // cells of partial world h, NULL for the heap
+    void (*init)(void);
+    void (*exchange)(partial_world *partial_world);
+    void (*finalize)(void);
+} halo_backend;
+
+// fresh nonblocking requests every generation
+static void
+halo_isend_exchange(partial_world *partial_world)
+{
+    int **cells = partial_world->cells;
+    int k = halo_depth;
 
-    int target_rank1 = rank - 1;
-    int target_rank2 = rank + 1;
-    if (target_rank1 < 0)
-        target_rank1 = size - 1;
-    if (target_rank2 >= size)
-        target_rank2 = 0;
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
+    {
+        MPI_Request requests[4];
+        MPI_Isend(&cells[1][1], 1, column_type, west, 2, cart_comm, &requests[0]);
+        MPI_Isend(&cells[1][partial_world->cols - k + 1], 1, column_type, east, 3, cart_comm, &requests[1]);
+        MPI_Irecv(&cells[1][1 - k], 1, column_type, west, 3, cart_comm, &requests[2]);
+        MPI_Irecv(&cells[1][partial_world->cols + 1], 1, column_type, east, 2, cart_comm, &requests[3]);
+        MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+    }
 
+    // k rows including their ghost columns are contiguous
+    int count = k * (partial_world->cols + 2 * k);
     MPI_Request request1, request2, request3, request4;
-    MPI_Isend(&cells[1][0], partial_world->cols + 2, MPI_INT, target_rank1, 0, MPI_COMM_WORLD, &request1);
-    MPI_Isend(&cells[partial_world->rows][0], partial_world->cols + 2, MPI_INT, target_rank2, 1, MPI_COMM_WORLD, &request2);
-    MPI_Irecv(&cells[0][0], partial_world->cols + 2, MPI_INT, target_rank1, 1, MPI_COMM_WORLD, &request3);
-    MPI_Irecv(&cells[partial_world->rows + 1][0], partial_world->cols + 2, MPI_INT, target_rank2, 0, MPI_COMM_WORLD, &request4);
+    MPI_Isend(&cells[1][1 - k], count, MPI_INT, north, 0, cart_comm, &request1);
+    MPI_Isend(&cells[partial_world->rows - k + 1][1 - k], count, MPI_INT, south, 1, cart_comm, &request2);
+    MPI_Irecv(&cells[1 - k][1 - k], count, MPI_INT, north, 1, cart_comm, &request3);
+    MPI_Irecv(&cells[partial_world->rows + 1][1 - k], count, MPI_INT, south, 0, cart_comm, &request4);
     MPI_Wait(&request1, MPI_STATUS_IGNORE);
     MPI_Wait(&request2, MPI_STATUS_IGNORE);
     MPI_Wait(&request3, MPI_STATUS_IGNORE);
     MPI_Wait(&request4, MPI_STATUS_IGNORE);
 }
 
-// caculate the next state of the partial world
+// persistent requests, set up once for each partial world of the history
+static MPI_Request column_requests[HISTORY][4], row_requests[HISTORY][4];
+
 static void
-partial_world_timestep(partial_world *old, partial_world *new)
+halo_persistent_init(void)
 {
-    int **cells = old->cells;
+    int k = halo_depth;
+    int count = k * (partial_world_cols + 2 * k);
+
+    for (int h = 0; h < HISTORY; h++)
+    {
+        int **cells = partial_worlds[h].cells;
 
-    for (int row = 1; row <= new->rows; ++row)
-        for (int col = 1; col <= new->cols; ++col)
+        if (west != rank)
         {
-            int row_m, row_p, col_m, col_p, nsum;
-            int newval;
+            MPI_Send_init(&cells[1][1], 1, column_type, west, 2, cart_comm, &column_requests[h][0]);
+            MPI_Send_init(&cells[1][partial_world_cols - k + 1], 1, column_type, east, 3, cart_comm, &column_requests[h][1]);
+            MPI_Recv_init(&cells[1][1 - k], 1, column_type, west, 3, cart_comm, &column_requests[h][2]);
+            MPI_Recv_init(&cells[1][partial_world_cols + 1], 1, column_type, east, 2, cart_comm, &column_requests[h][3]);
+        }
+        MPI_Send_init(&cells[1][1 - k], count, MPI_INT, north, 0, cart_comm, &row_requests[h][0]);
+        MPI_Send_init(&cells[partial_world_rows - k + 1][1 - k], count, MPI_INT, south, 1, cart_comm, &row_requests[h][1]);
+        MPI_Recv_init(&cells[1 - k][1 - k], count, MPI_INT, north, 1, cart_comm, &row_requests[h][2]);
+        MPI_Recv_init(&cells[partial_world_rows + 1][1 - k], count, MPI_INT, south, 0, cart_comm, &row_requests[h][3]);
+    }
+}
 
-            row_m = row - 1;
-            row_p = row + 1;
-            col_m = col - 1;
-            col_p = col + 1;
+static void
+halo_persistent_exchange(partial_world *partial_world)
+{
+    int h = partial_world - partial_worlds;
 
-            nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[row][col_m] + cells[row][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
+    {
+        MPI_Startall(4, column_requests[h]);
+        MPI_Waitall(4, column_requests[h], MPI_STATUSES_IGNORE);
+    }
 
-            switch (nsum)
-            {
-            case 3:
-                newval = 1;
-                break;
-            case 2:
-                newval = cells[row][col];
-                break;
-            default:
-                newval = 0;
-                break;
-            }
+    MPI_Startall(4, row_requests[h]);
+    MPI_Waitall(4, row_requests[h], MPI_STATUSES_IGNORE);
+}
 
-            new->cells[row][col] = newval;
+static void
+halo_persistent_finalize(void)
+{
+    for (int h = 0; h < HISTORY; h++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (west != rank)
+                MPI_Request_free(&column_requests[h][i]);
+            MPI_Request_free(&row_requests[h][i]);
         }
+    }
 }
 
-// check if the partial world is in a cycle
-static int
-partial_world_check_cycles(partial_world *cur_partial_world, int iter)
+// neighbourhood collective over the Cartesian communicator, the neighbours are
+// ordered north, south, west, east and the displacements are in bytes from the
+// first ghost cell, which is the same for every partial world of the history
+static int column_counts[4], row_counts[4];
+static MPI_Aint column_send_displs[4], column_recv_displs[4], row_send_displs[4], row_recv_displs[4];
+static MPI_Datatype neighbor_types[4];
+
+static void
+halo_neighbor_init(void)
 {
-    for (int i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
-    {
-        partial_world *prev_partial_world = &partial_worlds[i % HISTORY];
+    int **cells = partial_worlds[0].cells;
+    int k = halo_depth;
+    MPI_Aint base, addr;
+    MPI_Datatype row_type;
+
+#define DISPL(row, col) (MPI_Get_address(&cells[row][col], &addr), MPI_Aint_diff(addr, base))
+    MPI_Get_address(&cells[1 - k][1 - k], &base);
+
+    MPI_Type_contiguous(k * (partial_world_cols + 2 * k), MPI_INT, &row_type);
+    MPI_Type_commit(&row_type);
+    neighbor_types[0] = neighbor_types[1] = row_type;
+    neighbor_types[2] = neighbor_types[3] = column_type;
+
+    column_counts[0] = column_counts[1] = 0;
+    column_counts[2] = column_counts[3] = 1;
+    column_send_displs[0] = column_send_displs[1] = 0;
+    column_recv_displs[0] = column_recv_displs[1] = 0;
+    column_send_displs[2] = DISPL(1, 1);
+    column_send_displs[3] = DISPL(1, partial_world_cols - k + 1);
+    column_recv_displs[2] = DISPL(1, 1 - k);
+    column_recv_displs[3] = DISPL(1, partial_world_cols + 1);
+
+    row_counts[0] = row_counts[1] = 1;
+    row_counts[2] = row_counts[3] = 0;
+    row_send_displs[0] = DISPL(1, 1 - k);
+    row_send_displs[1] = DISPL(partial_world_rows - k + 1, 1 - k);
+    row_recv_displs[0] = DISPL(1 - k, 1 - k);
+    row_recv_displs[1] = DISPL(partial_world_rows + 1, 1 - k);
+    row_send_displs[2] = row_send_displs[3] = 0;
+    row_recv_displs[2] = row_recv_displs[3] = 0;
+#undef DISPL
+}
 
-        if (memcmp(&cur_partial_world->cells[0][0], &prev_partial_world->cells[0][0],
-                   (partial_world_rows + 2) * (partial_world_cols + 2) * sizeof(int)) == 0)
-            return i;
-    }
+static void
+halo_neighbor_exchange(partial_world *partial_world)
+{
+    int k = halo_depth;
+    int *base = &partial_world->cells[1 - k][1 - k];
 
-    return 0;
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
+        MPI_Neighbor_alltoallw(base, column_counts, column_send_displs, neighbor_types,
+                               base, column_counts, column_recv_displs, neighbor_types, cart_comm);
+
+    MPI_Neighbor_alltoallw(base, row_counts, row_send_displs, neighbor_types,
+                           base, row_counts, row_recv_displs, neighbor_types, cart_comm);
 }
 
-static int **
-alloc_2d_int_array(int nrows, int ncolumns)
+static void
+halo_neighbor_finalize(void)
 {
-    int **array;
-    int row;
+    MPI_Type_free(&neighbor_types[0]);
+}
 
-    /* version that keeps the 2d data contiguous, can help caching and slicing across dimensions */
-    array = malloc(nrows * sizeof(int *));
-    if (array == NULL)
-    {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
-    }
+// shape of the partial worlds of the neighbours north, south, west, east
+static int neighbor_rows[4], neighbor_cols[4];
 
-    array[0] = malloc(nrows * ncolumns * sizeof(int));
-    if (array[0] == NULL)
-    {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
-    }
+static void
+neighbor_shapes(void)
+{
+    int neighbors[4] = {north, south, west, east};
 
-    /* memory layout is row-major */
-    for (row = 1; row < nrows; row++)
+    for (int i = 0; i < 4; i++)
     {
-        array[row] = array[0] + row * ncolumns;
+        int neighbor_coords[2], start;
+
+        MPI_Cart_coords(cart_comm, neighbors[i], 2, neighbor_coords);
+        split_range(world_rows, dims[0], neighbor_coords[0], &start, &neighbor_rows[i]);
+        split_range(world_cols, dims[1], neighbor_coords[1], &start, &neighbor_cols[i]);
     }
+}
 
-    return array;
+// offset of a cell in the partial world of neighbour i, indexed like the local cells
+static size_t
+neighbor_offset(int i, int row, int col)
+{
+    int k = halo_depth;
+
+    return (size_t)(row + k - 1) * (neighbor_cols[i] + 2 * k) + (col + k - 1);
 }
 
-static double
-time_secs(void)
+/* Partial worlds in MPI-3 shared memory windows, one window per partial world
+ * of the history. Neighbours on the same node copy each other's boundary cells
+ * directly between node barriers, only the boundaries to other nodes use
+ * messages.
+ */
+static MPI_Comm node_comm;
+static MPI_Win shared_wins[HISTORY];
+static int *neighbor_bases[HISTORY][4]; // on the node, NULL for other nodes
+
+static int **
+halo_shared_alloc(int h, int rows, int cols, int halo)
 {
-    struct timeval tv;
+    MPI_Info info;
+    int *data;
 
-    if (gettimeofday(&tv, 0) != 0)
-    {
-        fprintf(stderr, "could not do timing\n");
-        exit(1);
-    }
+    if (h == 0)
+        MPI_Comm_split_type(cart_comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
 
-    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+    // every rank keeps its partial world in its own, locally touched memory
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    MPI_Win_allocate_shared((MPI_Aint)(rows + 2 * halo) * (cols + 2 * halo) * sizeof(int), sizeof(int),
+                            info, node_comm, &data, &shared_wins[h]);
+    MPI_Info_free(&info);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, shared_wins[h]);
+
+    return shift_partial_world_cells(make_2d_int_array(data, rows + 2 * halo, cols + 2 * halo), rows, halo);
 }
 
-// rank0 collects the partial worlds from other ranks
 static void
-collect_world(void)
+halo_shared_init(void)
 {
-    if (rank != 0)
-        for (int i = 1; i <= partial_world_rows; i++)
-            MPI_Send(&cur_partial_world->cells[i][1], partial_world_cols, MPI_INT, 0, i + partial_world_start, MPI_COMM_WORLD);
-    else
+    int neighbors[4] = {north, south, west, east};
+    int node_ranks[4];
+    MPI_Group cart_group, node_group;
+
+    MPI_Comm_group(cart_comm, &cart_group);
+    MPI_Comm_group(node_comm, &node_group);
+    MPI_Group_translate_ranks(cart_group, 4, neighbors, node_group, node_ranks);
+    MPI_Group_free(&cart_group);
+    MPI_Group_free(&node_group);
+
+    neighbor_shapes();
+    for (int i = 0; i < 4; i++)
     {
-        for (int i = 1; i <= partial_world_rows; i++)
-            for (int j = 1; j <= partial_world_cols; j++)
-                cur_world->cells[i + partial_world_start][j] = cur_partial_world->cells[i][j];
-        for (int i = 1 + partial_world_rows; i <= world_rows; i++)
-            MPI_Recv(&cur_world->cells[i][1], partial_world_cols, MPI_INT, MPI_ANY_SOURCE, i, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        for (int h = 0; h < HISTORY; h++)
+        {
+            MPI_Aint bytes;
+            int disp_unit;
+
+            neighbor_bases[h][i] = NULL;
+            if (node_ranks[i] != MPI_UNDEFINED)
+                MPI_Win_shared_query(shared_wins[h], node_ranks[i], &bytes, &disp_unit, &neighbor_bases[h][i]);
+        }
     }
 }
 
-int main(int argc, char *argv[])
+// cell of neighbour i in partial world h
+static int *
+neighbor_cell(int h, int i, int row, int col)
 {
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return neighbor_bases[h][i] + neighbor_offset(i, row, col);
+}
 
-    int h, nsteps;
-    double start_time, end_time, elapsed_time;
+// make the neighbours' writes visible and wait until they are done
+static void
+halo_shared_sync(int h)
+{
+    MPI_Win_sync(shared_wins[h]);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(shared_wins[h]);
+}
 
-    /* Get Parameters */
-    if (argc != 6)
-    {
-        fprintf(stderr, "Usage: %s rows cols steps worldstep cellstep\n", argv[0]);
-        exit(1);
-    }
-    world_rows = atoi(argv[1]);
-    world_cols = atoi(argv[2]);
-    nsteps = atoi(argv[3]);
-    print_world = atoi(argv[4]);
-    print_cells = atoi(argv[5]);
+static void
+halo_shared_exchange(partial_world *partial_world)
+{
+    int **cells = partial_world->cells;
+    int h = partial_world - partial_worlds;
+    int k = halo_depth;
+    int rows = partial_world->rows, cols = partial_world->cols;
+    MPI_Request requests[4];
+    int nrequests = 0;
 
-    // initialize the world
-    cur_world = (world *)malloc(sizeof(world));
-    cur_world->rows = world_rows;
-    cur_world->cols = world_cols;
-    cur_world->cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
+    halo_shared_sync(h);
 
-    if (rank == 0)
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
     {
-        if (random_world)
-            world_init_random(cur_world);
-        else
-            world_init_fixed(cur_world);
+        if (neighbor_bases[h][2] == NULL)
+        {
+            MPI_Isend(&cells[1][1], 1, column_type, west, 2, cart_comm, &requests[nrequests++]);
+            MPI_Irecv(&cells[1][1 - k], 1, column_type, west, 3, cart_comm, &requests[nrequests++]);
+        }
+        if (neighbor_bases[h][3] == NULL)
+        {
+            MPI_Isend(&cells[1][cols - k + 1], 1, column_type, east, 3, cart_comm, &requests[nrequests++]);
+            MPI_Irecv(&cells[1][cols + 1], 1, column_type, east, 2, cart_comm, &requests[nrequests++]);
+        }
 
-        if (print_world > 0)
+#pragma omp parallel for schedule(static)
+        for (int row = 1; row <= rows; row++)
         {
-            printf("\ninitial world:\n\n");
-            world_print(cur_world);
+            if (neighbor_bases[h][2] != NULL)
+                memcpy(&cells[row][1 - k], neighbor_cell(h, 2, row, neighbor_cols[2] - k + 1), k * sizeof(int));
+            if (neighbor_bases[h][3] != NULL)
+                memcpy(&cells[row][cols + 1], neighbor_cell(h, 3, row, 1), k * sizeof(int));
         }
+
+        MPI_Waitall(nrequests, requests, MPI_STATUSES_IGNORE);
+        nrequests = 0;
     }
 
-    // broadcast the world to other ranks
-    MPI_Bcast(&cur_world->cells[0][0], (world_rows + 2) * (world_cols + 2), MPI_INT, 0, MPI_COMM_WORLD);
+    // the rows below take the ghost columns of the neighbours along
+    halo_shared_sync(h);
 
-    // initialize the partial world
-    if (world_rows % size == 0)
+    // k rows including their ghost columns are contiguous
+    int count = k * (cols + 2 * k);
+    if (neighbor_bases[h][0] == NULL)
     {
-        partial_world_rows = world_rows / size;
-        partial_world_start = rank * partial_world_rows;
-        partial_world_end = (rank + 1) * partial_world_rows - 1;
+        MPI_Isend(&cells[1][1 - k], count, MPI_INT, north, 0, cart_comm, &requests[nrequests++]);
+        MPI_Irecv(&cells[1 - k][1 - k], count, MPI_INT, north, 1, cart_comm, &requests[nrequests++]);
     }
     else
+        memcpy(&cells[1 - k][1 - k], neighbor_cell(h, 0, neighbor_rows[0] - k + 1, 1 - k), count * sizeof(int));
+    if (neighbor_bases[h][1] == NULL)
     {
-        int quotient = world_rows / size;
-        int remainder = world_rows % size;
-        if (rank < remainder)
-        {
-            partial_world_rows = quotient + 1;
-            partial_world_start = rank * partial_world_rows;
-            partial_world_end = (rank + 1) * partial_world_rows - 1;
-        }
-        else
-        {
-            partial_world_rows = quotient;
-            partial_world_start = remainder * (quotient + 1) + (rank - remainder) * quotient;
-            partial_world_end = remainder * (quotient + 1) + (rank - remainder + 1) * quotient - 1;
-        }
+        MPI_Isend(&cells[rows - k + 1][1 - k], count, MPI_INT, south, 1, cart_comm, &requests[nrequests++]);
+        MPI_Irecv(&cells[rows + 1][1 - k], count, MPI_INT, south, 0, cart_comm, &requests[nrequests++]);
     }
-    partial_world_cols = world_cols;
+    else
+        memcpy(&cells[rows + 1][1 - k], neighbor_cell(h, 1, 1, 1 - k), count * sizeof(int));
+    MPI_Waitall(nrequests, requests, MPI_STATUSES_IGNORE);
 
-    for (h = 0; h < HISTORY; h++)
+    // nobody overwrites cells that a neighbour may still be reading
+    halo_shared_sync(h);
+}
+
+static void
+halo_shared_finalize(void)
+{
+    for (int h = 0; h < HISTORY; h++)
     {
-        partial_worlds[h].rows = partial_world_rows;
-        partial_worlds[h].cols = partial_world_cols;
-        partial_worlds[h].cells = alloc_2d_int_array(partial_world_rows + 2, partial_world_cols + 2);
+        MPI_Win_unlock_all(shared_wins[h]);
+        MPI_Win_free(&shared_wins[h]);
     }
+    MPI_Comm_free(&node_comm);
+}
 
-    cur_partial_world = &partial_worlds[world_iter % HISTORY];
+/* One-sided exchange: every partial world of the history is exposed in an
+ * MPI window and each rank puts its boundary cells straight into the ghost
+ * cells of its neighbours. The epochs are either synchronised with
+ * post-start-complete-wait among the neighbours only, or with fences.
+ */
+static MPI_Win rma_wins[HISTORY];
+static MPI_Datatype rma_column_types[4]; // ghost columns of the west and east neighbours
+static MPI_Group column_group, row_group;
+
+// group of the distinct ranks among the two neighbours
+static MPI_Group
+neighbor_group(int a, int b)
+{
+    MPI_Group cart_group, group;
+    int ranks[2] = {a, b};
 
-    // use the received world to initialize the partial world
-    for (int i = 1; i <= partial_world_rows; i++)
-    {
-        for (int j = 1; j <= partial_world_cols; j++)
-        {
-            cur_partial_world->cells[i][j] = cur_world->cells[i + partial_world_start][j];
-        }
-    }
+    MPI_Comm_group(cart_comm, &cart_group);
+    MPI_Group_incl(cart_group, a == b ? 1 : 2, ranks, &group);
+    MPI_Group_free(&cart_group);
 
-    if (rank == 0)
-        start_time = time_secs();
+    return group;
+}
 
-    /*  time steps */
-    partial_world_border_wrap(cur_partial_world);
-    for (world_iter = 1; world_iter < nsteps; world_iter++)
-    {
-        partial_world *next_partial_world = &partial_worlds[world_iter % HISTORY];
-        partial_world_timestep(cur_partial_world, next_partial_world);
-        cur_partial_world = next_partial_world;
+// a rank that is its own neighbour on all sides wraps locally and needs no
+// windows, Open MPI cannot create them on a communicator of one process
+static int
+halo_rma_local(void)
+{
+    return west == rank && north == rank;
+}
 
-        partial_world_border_wrap(cur_partial_world);
+static void
+halo_rma_init(void)
+{
+    int k = halo_depth;
 
-        int cycle = partial_world_check_cycles(cur_partial_world, world_iter);
-        if (rank != 0)
-            MPI_Send(&cycle, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        else
-        {
-            for (int i = 1; i < size; i++)
-            {
-                int tmp;
-                MPI_Recv(&tmp, 1, MPI_INT, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                // if all ranks are in cycles, then the whole world is in a cycle
-                cycle = cycle == tmp ? cycle : 0;
-            }
-            if (cycle)
-                printf("world iteration %d is equal to iteration %d\n", world_iter, cycle);
-        }
+    if (halo_rma_local())
+        return;
 
-        if (print_cells > 0 && (world_iter % print_cells) == (print_cells - 1))
-        {
-            collect_world();
-            if (rank == 0)
-                printf("%d: %d live cells\n", world_iter, world_count(cur_world));
-        }
+    neighbor_shapes();
+    for (int h = 0; h < HISTORY; h++)
+    {
+        int **cells = partial_worlds[h].cells;
 
-        if (print_world > 0 && (world_iter % print_world) == (print_world - 1))
-        {
-            collect_world();
-            if (rank == 0)
+        MPI_Win_create(&cells[1 - k][1 - k],
+                       (MPI_Aint)(partial_world_rows + 2 * k) * (partial_world_cols + 2 * k) * sizeof(int),
+                       sizeof(int), MPI_INFO_NULL, cart_comm, &rma_wins[h]);
+    }
+
+    for (int i = 2; i < 4; i++)
+    {
+        MPI_Type_vector(partial_world_rows, k, neighbor_cols[i] + 2 * k, MPI_INT, &rma_column_types[i]);
+        MPI_Type_commit(&rma_column_types[i]);
+    }
+
+    column_group = neighbor_group(west, east);
+    row_group = neighbor_group(north, south);
+}
+
+static void
+halo_rma_put_columns(partial_world *partial_world, MPI_Win win)
+{
+    int **cells = partial_world->cells;
+    int k = halo_depth;
+
+    MPI_Put(&cells[1][1], 1, column_type, west, neighbor_offset(2, 1, neighbor_cols[2] + 1), 1, rma_column_types[2], win);
+    MPI_Put(&cells[1][partial_world->cols - k + 1], 1, column_type, east, neighbor_offset(3, 1, 1 - k), 1, rma_column_types[3], win);
+}
+
+static void
+halo_rma_put_rows(partial_world *partial_world, MPI_Win win)
+{
+    int **cells = partial_world->cells;
+    int k = halo_depth;
+    int count = k * (partial_world->cols + 2 * k);
+
+    MPI_Put(&cells[1][1 - k], count, MPI_INT, north, neighbor_offset(0, neighbor_rows[0] + 1, 1 - k), count, MPI_INT, win);
+    MPI_Put(&cells[partial_world->rows - k + 1][1 - k], count, MPI_INT, south, neighbor_offset(1, 1 - k, 1 - k), count, MPI_INT, win);
+}
+
+static void
+halo_pscw_exchange(partial_world *partial_world)
+{
+    MPI_Win win = rma_wins[partial_world - partial_worlds];
+
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
+    {
+        MPI_Win_post(column_group, 0, win);
+        MPI_Win_start(column_group, 0, win);
+        halo_rma_put_columns(partial_world, win);
+        MPI_Win_complete(win);
+        MPI_Win_wait(win);
+    }
+
+    if (north == rank)
+        partial_world_wrap_rows(partial_world);
+    else
+    {
+        MPI_Win_post(row_group, 0, win);
+        MPI_Win_start(row_group, 0, win);
+        halo_rma_put_rows(partial_world, win);
+        MPI_Win_complete(win);
+        MPI_Win_wait(win);
+    }
+}
+
+static void
+halo_fence_exchange(partial_world *partial_world)
+{
+    MPI_Win win = rma_wins[partial_world - partial_worlds];
+
+    if (halo_rma_local())
+    {
+        partial_world_wrap_columns(partial_world);
+        partial_world_wrap_rows(partial_world);
+        return;
+    }
+
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, win);
+    if (west == rank)
+        partial_world_wrap_columns(partial_world);
+    else
+        halo_rma_put_columns(partial_world, win);
+    MPI_Win_fence(0, win);
+    halo_rma_put_rows(partial_world, win);
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, win);
+}
+
+static void
+halo_rma_finalize(void)
+{
+    if (halo_rma_local())
+        return;
+
+    for (int h = 0; h < HISTORY; h++)
+        MPI_Win_free(&rma_wins[h]);
+    for (int i = 2; i < 4; i++)
+        MPI_Type_free(&rma_column_types[i]);
+    MPI_Group_free(&column_group);
+    MPI_Group_free(&row_group);
+}
+
+static const halo_backend halo_backends[] = {
+    {"isend", NULL, NULL, halo_isend_exchange, NULL},
+    {"persistent", NULL, halo_persistent_init, halo_persistent_exchange, halo_persistent_finalize},
+    {"neighbor", NULL, halo_neighbor_init, halo_neighbor_exchange, halo_neighbor_finalize},
+    {"shared", halo_shared_alloc, halo_shared_init, halo_shared_exchange, halo_shared_finalize},
+    {"pscw", NULL, halo_rma_init, halo_pscw_exchange, halo_rma_finalize},
+    {"fence", NULL, halo_rma_init, halo_fence_exchange, halo_rma_finalize},
+};
+
+static const halo_backend *halo = &halo_backends[0];
+
+static const halo_backend *
+find_halo_backend(const char *name)
+{
+    for (int i = 0; i < sizeof(halo_backends) / sizeof(halo_backend); i++)
+        if (strcmp(name, halo_backends[i].name) == 0)
+            return &halo_backends[i];
+
+    return NULL;
+}
+
+// fill ghost cells through MPI, halo_depth of them on each side
+static void
+partial_world_border_wrap(partial_world *partial_world)
+{
+    halo->exchange(partial_world);
+}
+
+// caculate the next state of the partial world
+// extra is the number of ghost cells on each side that are computed as well
+static void
+partial_world_timestep(partial_world *old, partial_world *new, int extra)
+{
+    int **cells = old->cells;
+    uint64_t fingerprint = 0;
+    int live = 0;
+
+    // the thread team splits the rows, MPI is only called outside of this loop;
+    // the fingerprint and live count of the interior are taken while the new
+    // row is in cache
+#pragma omp parallel for schedule(static) reduction(+ : fingerprint, live)
+    for (int row = 1 - extra; row <= new->rows + extra; ++row)
+    {
+        row_step(&cells[row - 1][1 - extra], &cells[row][1 - extra], &cells[row + 1][1 - extra],
+                 &new->cells[row][1 - extra], new->cols + 2 * extra);
+        if (row >= 1 && row <= new->rows)
+        {
+            fingerprint += cycle_row_fingerprint(partial_world_start + row, partial_world_col_start + 1,
+                                                 &new->cells[row][1], new->cols);
+            live += row_count(&new->cells[row][1], new->cols);
+        }
+    }
+    new->fingerprint = fingerprint;
+    new->live = live;
+}
+
+static uint64_t
+partial_world_fingerprint(partial_world *partial_world)
+{
+    uint64_t fingerprint = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : fingerprint)
+    for (int row = 1; row <= partial_world->rows; row++)
+        fingerprint += cycle_row_fingerprint(partial_world_start + row, partial_world_col_start + 1,
+                                             &partial_world->cells[row][1], partial_world->cols);
+
+    return fingerprint;
+}
+
+static int
+partial_world_count(partial_world *partial_world)
+{
+    int live = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : live)
+    for (int row = 1; row <= partial_world->rows; row++)
+        live += row_count(&partial_world->cells[row][1], partial_world->cols);
+
+    return live;
+}
+
+// compute generation iter from the current partial world
+static void
+partial_world_advance(int iter)
+{
+    partial_world *next_partial_world = &partial_worlds[iter % HISTORY];
+    partial_world_timestep(cur_partial_world, next_partial_world, halo_depth - 1 - (iter - 1) % halo_depth);
+    cur_partial_world = next_partial_world;
+
+    // the innermost ghost cells are still valid between exchanges
+    if (iter % halo_depth == 0)
+        partial_world_border_wrap(cur_partial_world);
+}
+
+// check if the partial world is in a cycle
+static int
+partial_world_check_cycles(partial_world *cur_partial_world, int iter)
+{
+    for (int i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
+    {
+        partial_world *prev_partial_world = &partial_worlds[i % HISTORY];
+        int differ = 0;
+
+        // only partial worlds with the same fingerprint are compared
+        if (prev_partial_world->fingerprint != cur_partial_world->fingerprint)
+            continue;
+
+#pragma omp parallel for schedule(static) reduction(| : differ)
+        for (int row = 0; row <= partial_world_rows + 1; row++)
+            differ |= memcmp(cur_partial_world->cells[row], prev_partial_world->cells[row],
+                             (partial_world_cols + 2) * sizeof(int)) != 0;
+
+        if (!differ)
+            return i;
+    }
+
+    return 0;
+}
+
+static double
+time_secs(void)
+{
+    struct timeval tv;
+
+    if (gettimeofday(&tv, 0) != 0)
+    {
+        fprintf(stderr, "could not do timing\n");
+        exit(1);
+    }
+
+    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// rank0 gathers the interior cells of all partial worlds, every rank packs
+// them into one contiguous block and rank0 unpacks the blocks into the world;
+// only print_world needs the whole world, so only then rank0 holds it; with
+// -a the blocks go to the output slots instead of gather_world
+static int *gather_block;                                // interior cells of this rank
+static int *gather_world, *gather_counts, *gather_displs; // blocks of all ranks, on rank0
+static int *gather_shapes; // first row, rows, first column and columns of the block of each rank, on rank0
+
+static void
+collect_world_init(void)
+{
+    gather_block = malloc(partial_world_rows * partial_world_cols * sizeof(int));
+    if (gather_block == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    if (rank != 0 || print_world == 0)
+        return;
+
+    cur_world = (world *)malloc(sizeof(world));
+    if (cur_world == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    cur_world->rows = world_rows;
+    cur_world->cols = world_cols;
+    cur_world->cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
+
+    if (!async_output)
+        gather_world = malloc(world_rows * world_cols * sizeof(int));
+    gather_counts = malloc(size * sizeof(int));
+    gather_displs = malloc(size * sizeof(int));
+    gather_shapes = malloc(4 * size * sizeof(int));
+    if ((!async_output && gather_world == NULL) || gather_counts == NULL || gather_displs == NULL ||
+        gather_shapes == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int r = 0, displ = 0; r < size; r++)
+    {
+        int rank_coords[2], *shape = &gather_shapes[4 * r];
+
+        MPI_Cart_coords(cart_comm, r, 2, rank_coords);
+        split_range(world_rows, dims[0], rank_coords[0], &shape[0], &shape[1]);
+        split_range(world_cols, dims[1], rank_coords[1], &shape[2], &shape[3]);
+        gather_counts[r] = shape[1] * shape[3];
+        gather_displs[r] = displ;
+        displ += shape[1] * shape[3];
+    }
+}
+
+static void
+partial_world_pack(partial_world *partial_world, int *block)
+{
+    for (int i = 1; i <= partial_world_rows; i++)
+        memcpy(&block[(i - 1) * partial_world_cols], &partial_world->cells[i][1], partial_world_cols * sizeof(int));
+}
+
+// copy the gathered blocks of all ranks into the world, no MPI calls
+static void
+world_unpack(world *world, const int *blocks)
+{
+    for (int r = 0; r < size; r++)
+    {
+        const int *shape = &gather_shapes[4 * r], *block = &blocks[gather_displs[r]];
+
+        for (int i = 1; i <= shape[1]; i++)
+            memcpy(&world->cells[i + shape[0]][1 + shape[2]], &block[(i - 1) * shape[3]], shape[3] * sizeof(int));
+    }
+}
+
+static void
+collect_world(partial_world *partial_world)
+{
+    partial_world_pack(partial_world, gather_block);
+
+    MPI_Gatherv(gather_block, partial_world_rows * partial_world_cols, MPI_INT,
+                gather_world, gather_counts, gather_displs, MPI_INT, 0, cart_comm);
+
+    if (rank == 0)
+        world_unpack(cur_world, gather_world);
+}
+
+/* Asynchronous output with -a: a background thread on rank0 writes the worlds
+ * while all ranks go on stepping. A snapshot packs the block of every rank
+ * into one of two staging slots and starts a nonblocking gather into the slot
+ * on rank0; once the gather is complete, rank0 hands the slot to the thread,
+ * which unpacks, renders and writes it without calling MPI. A slot is reused
+ * two snapshots later, only then a rank waits for it. Text that rank0 prints
+ * while worlds are in flight is held back and written by the thread ahead of
+ * the next world, so the output comes in the same order as without -a.
+ */
+enum
+{
+    SLOT_FREE,
+    SLOT_GATHERING,
+    SLOT_QUEUED // handed to the thread, until it has written the world
+};
+
+typedef struct
+{
+    char *data;
+    size_t length, capacity;
+} output_text;
+
+typedef struct
+{
+    int *block;  // packed block of this rank
+    int *blocks; // blocks of all ranks, on rank0
+    MPI_Request request;
+    int state;        // on rank0
+    output_text text; // written before the world, on rank0
+} output_slot;
+
+static output_slot output_slots[2];
+static int output_next;           // slot of the next snapshot
+static output_text output_held;   // text printed since the last snapshot, on rank0
+static int output_done;           // no more snapshots
+static pthread_t output_thread;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER; // guards the states and output_done
+static pthread_cond_t output_cond = PTHREAD_COND_INITIALIZER;
+
+static void *
+output_thread_main(void *arg)
+{
+    int next = 0;
+
+    pthread_mutex_lock(&output_lock);
+    for (;;)
+    {
+        output_slot *slot = &output_slots[next];
+
+        // the slots are written in the order of the snapshots
+        while (slot->state != SLOT_QUEUED && !(output_done && slot->state == SLOT_FREE))
+            pthread_cond_wait(&output_cond, &output_lock);
+        if (slot->state != SLOT_QUEUED)
+            break;
+        pthread_mutex_unlock(&output_lock);
+
+        fwrite(slot->text.data, 1, slot->text.length, stdout);
+        slot->text.length = 0;
+        world_unpack(cur_world, slot->blocks);
+        world_print(cur_world);
+
+        pthread_mutex_lock(&output_lock);
+        slot->state = SLOT_FREE;
+        pthread_cond_broadcast(&output_cond);
+        next ^= 1;
+    }
+    pthread_mutex_unlock(&output_lock);
+    fflush(stdout);
+
+    return NULL;
+}
+
+static void
+output_init(void)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        output_slot *slot = &output_slots[s];
+
+        slot->block = malloc(partial_world_rows * partial_world_cols * sizeof(int));
+        slot->blocks = rank == 0 ? malloc(world_rows * world_cols * sizeof(int)) : NULL;
+        if (slot->block == NULL || (rank == 0 && slot->blocks == NULL))
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        slot->request = MPI_REQUEST_NULL;
+        slot->state = SLOT_FREE;
+    }
+    if (rank == 0 && pthread_create(&output_thread, NULL, output_thread_main, NULL) != 0)
+    {
+        fprintf(stderr, "cannot start the output thread\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+// is any world in flight? call with output_lock held
+static int
+output_busy(void)
+{
+    return output_slots[0].state != SLOT_FREE || output_slots[1].state != SLOT_FREE;
+}
+
+// after the gather of the slot completed, rank0 queues it for the thread
+static void
+output_gathered(output_slot *slot)
+{
+    if (rank != 0)
+        return;
+    pthread_mutex_lock(&output_lock);
+    if (slot->state == SLOT_GATHERING)
+    {
+        slot->state = SLOT_QUEUED;
+        pthread_cond_broadcast(&output_cond);
+    }
+    pthread_mutex_unlock(&output_lock);
+}
+
+// write the held back text once no world is in flight any more, on rank0
+static void
+output_release(void)
+{
+    int busy;
+
+    if (output_held.length == 0)
+        return;
+    pthread_mutex_lock(&output_lock);
+    busy = output_busy();
+    pthread_mutex_unlock(&output_lock);
+    if (!busy)
+    {
+        fwrite(output_held.data, 1, output_held.length, stdout);
+        output_held.length = 0;
+    }
+}
+
+// printf on rank0, in order with the worlds written by the thread
+static void
+output_printf(const char *format, ...)
+{
+    va_list args;
+    int busy = 0;
+
+    if (async_output)
+    {
+        output_release();
+        pthread_mutex_lock(&output_lock);
+        busy = output_busy();
+        pthread_mutex_unlock(&output_lock);
+    }
+
+    va_start(args, format);
+    if (!busy)
+        vprintf(format, args);
+    else
+    {
+        va_list copy;
+        int n;
+
+        va_copy(copy, args);
+        n = vsnprintf(NULL, 0, format, copy);
+        va_end(copy);
+        stream_grow((void **)&output_held.data, &output_held.capacity, output_held.length + n + 1, 1);
+        vsnprintf(&output_held.data[output_held.length], n + 1, format, args);
+        output_held.length += n;
+    }
+    va_end(args);
+}
+
+// drive the gathers in flight, called once per generation by all ranks
+static void
+output_progress(void)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        output_slot *slot = &output_slots[s];
+        int done;
+
+        if (slot->request == MPI_REQUEST_NULL)
+            continue;
+        MPI_Test(&slot->request, &done, MPI_STATUS_IGNORE);
+        if (done)
+            output_gathered(slot);
+    }
+    if (rank == 0)
+        output_release();
+}
+
+// start writing the world of the partial worlds, collective
+static void
+output_snapshot(partial_world *partial_world)
+{
+    output_slot *slot = &output_slots[output_next];
+
+    output_next ^= 1;
+    MPI_Wait(&slot->request, MPI_STATUS_IGNORE);
+    output_gathered(slot);
+    if (rank == 0)
+    {
+        output_text held = output_held;
+
+        pthread_mutex_lock(&output_lock);
+        while (slot->state != SLOT_FREE)
+            pthread_cond_wait(&output_cond, &output_lock);
+        // the text held back so far goes ahead of this world
+        output_held = slot->text;
+        slot->text = held;
+        slot->state = SLOT_GATHERING;
+        pthread_mutex_unlock(&output_lock);
+    }
+
+    partial_world_pack(partial_world, slot->block);
+    MPI_Igatherv(slot->block, partial_world_rows * partial_world_cols, MPI_INT,
+                 slot->blocks, gather_counts, gather_displs, MPI_INT, 0, cart_comm, &slot->request);
+}
+
+// wait for all worlds to be written and stop the thread, collective
+static void
+output_finish(void)
+{
+    for (int s = 0; s < 2; s++)
+    {
+        MPI_Wait(&output_slots[s].request, MPI_STATUS_IGNORE);
+        output_gathered(&output_slots[s]);
+    }
+    if (rank != 0)
+        return;
+
+    pthread_mutex_lock(&output_lock);
+    output_done = 1;
+    pthread_cond_broadcast(&output_cond);
+    pthread_mutex_unlock(&output_lock);
+    pthread_join(output_thread, NULL);
+    output_release();
+}
+
+// print the world, rank0 prints the text before it with output_printf; collective
+static void
+output_world(partial_world *partial_world)
+{
+    if (async_output)
+    {
+        output_snapshot(partial_world);
+        return;
+    }
+    collect_world(partial_world);
+    if (rank == 0)
+        world_print(cur_world);
+}
+
+static void
+partial_world_init_fixed(partial_world *partial_world)
+{
+    int **cells = partial_world->cells;
+    int row, col;
+
+    /* use predefined start_world, every rank takes its own block of it */
+
+    for (int i = 1; i <= partial_world->rows; i++)
+    {
+        for (int j = 1; j <= partial_world->cols; j++)
+        {
+            row = i + partial_world_start;
+            col = j + partial_world_col_start;
+            if ((row <= sizeof(start_world) / sizeof(char *)) &&
+                (col <= strlen(start_world[row - 1])))
+            {
+                cells[i][j] = (start_world[row - 1][col - 1] != '.');
+            }
+            else
+            {
+                cells[i][j] = 0;
+            }
+        }
+    }
+}
+
+static void
+partial_world_set_cell(void *ctx, int row, int col)
+{
+    ((partial_world *)ctx)->cells[row - partial_world_start][col - partial_world_col_start] = 1;
+}
+
+// point the pattern at the last row start up to the first row of this rank:
+// every rank counts the row starts of one part of the body, the counts are
+// summed up with MPI_Exscan and the marks of all parts are gathered, so every
+// rank knows which part holds its first row and scans only that part again
+static void
+partial_world_pattern_seek(void)
+{
+    long target = partial_world_start + 1, base = start_pattern.format == PATTERN_RLE ? 1 : 0;
+    long count, before = 0, mine[4], *marks;
+    const char *from, *to;
+    pattern_mark first, last;
+    int ended, ended_before = 0, part = -1;
+
+    if (start_pattern.format == PATTERN_LIFE106)
+        return;
+
+    // row counts relative to the start of the part first
+    pattern_part(&start_pattern, rank, size, &from, &to);
+    count = pattern_scan(&start_pattern, from, to, 0, LONG_MAX, &first, &last, &ended);
+    MPI_Exscan(&count, &before, 1, MPI_LONG, MPI_SUM, cart_comm);
+    MPI_Exscan(&ended, &ended_before, 1, MPI_INT, MPI_LOR, cart_comm);
+    if (rank == 0)
+        before = ended_before = 0;
+
+    // first mark, last mark and its offset, row count at the start of the part;
+    // the marks after the end of the pattern are dropped
+    mine[0] = ended_before || first.row == 0 ? 0 : base + before + first.row;
+    mine[1] = ended_before || first.row == 0 ? 0 : base + before + last.row;
+    mine[2] = ended_before || first.row == 0 ? 0 : last.pos - start_pattern.data;
+    mine[3] = base + before;
+    marks = malloc(4 * size * sizeof(long));
+    if (marks == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    MPI_Allgather(mine, 4, MPI_LONG, marks, 4, MPI_LONG, cart_comm);
+
+    for (int r = 0; r < size; r++)
+        if (marks[4 * r] != 0 && marks[4 * r] <= target)
+            part = r;
+    if (part < 0)
+    {
+        start_pattern.start = start_pattern.body;
+        start_pattern.start_row = 1;
+    }
+    else if (marks[4 * part + 1] <= target)
+    {
+        start_pattern.start = start_pattern.data + marks[4 * part + 2];
+        start_pattern.start_row = marks[4 * part + 1];
+    }
+    else
+    {
+        pattern_part(&start_pattern, part, size, &from, &to);
+        pattern_scan(&start_pattern, from, to, marks[4 * part + 3], target, &first, &last, &ended);
+        start_pattern.start = last.pos;
+        start_pattern.start_row = last.row;
+    }
+    free(marks);
+}
+
+// every rank maps the pattern file and parses only its own block of it
+static void
+partial_world_init_pattern(partial_world *partial_world)
+{
+    for (int i = 1; i <= partial_world->rows; i++)
+        memset(&partial_world->cells[i][1], 0, partial_world->cols * sizeof(int));
+    partial_world_pattern_seek();
+    pattern_fill(&start_pattern, partial_world_start + 1, partial_world_end + 1,
+                 partial_world_col_start + 1, partial_world_col_end + 1, partial_world_set_cell, partial_world);
+}
+
+// every rank draws its own block, the cells come out the same for any
+// process grid and number of threads, see gol-rng.h
+static void
+partial_world_init_random(partial_world *partial_world)
+{
+#pragma omp parallel for schedule(static)
+    for (int i = 1; i <= partial_world->rows; i++)
+        rng_row(&partial_world->cells[i][1], (uint64_t)(partial_world_start + i - 1) * world_cols + partial_world_col_start,
+                partial_world->cols);
+}
+
+// interior cells of the partial world against the cycle snapshot
+static int
+partial_world_equal_snapshot(partial_world *partial_world)
+{
+    int differ = 0;
+
+#pragma omp parallel for schedule(static) reduction(| : differ)
+    for (int row = 1; row <= partial_world_rows; row++)
+        differ |= memcmp(&partial_world->cells[row][1], &cycle_snapshot[row][1], partial_world_cols * sizeof(int)) != 0;
+
+    return !differ;
+}
+
+static int
+compare_runs(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// record generation iter, the partial world cur, as a delta against prev or
+// as a keyframe if prev is NULL
+static void
+stream_generation(int iter, partial_world *cur, partial_world *prev)
+{
+    int key = prev == NULL || stream_key_due(stream_last, iter, stream_key_every);
+    int nruns = 0, nvalues, total = 0;
+
+    for (int row = 1; row <= cur->rows; row++)
+    {
+        const int *cells = &cur->cells[row][1], *old = key ? NULL : &prev->cells[row][1];
+        uint64_t index = (uint64_t)(partial_world_start + row - 1) * world_cols + partial_world_col_start;
+
+        if (!key && memcmp(cells, old, cur->cols * sizeof(int)) == 0)
+            continue;
+        for (int col = 0; col < cur->cols; col++)
+        {
+            if (key ? !cells[col] : cells[col] == old[col])
+                continue;
+            if (nruns > 0 && stream_runs[2 * nruns - 2] + stream_runs[2 * nruns - 1] == index + col)
+                stream_runs[2 * nruns - 1]++;
+            else
             {
-                printf("\nat time step %d:\n\n", world_iter);
-                world_print(cur_world);
+                stream_grow((void **)&stream_runs, &stream_runs_capacity, 2 * nruns + 2, sizeof(uint64_t));
+                stream_runs[2 * nruns] = index + col;
+                stream_runs[2 * nruns + 1] = 1;
+                nruns++;
             }
         }
+    }
+
+    nvalues = 2 * nruns;
+    MPI_Gather(&nvalues, 1, MPI_INT, stream_counts, 1, MPI_INT, 0, cart_comm);
+    if (rank == 0)
+    {
+        for (int r = 0; r < size; r++)
+        {
+            stream_displs[r] = total;
+            total += stream_counts[r];
+        }
+        stream_grow((void **)&stream_all_runs, &stream_all_capacity, total, sizeof(uint64_t));
+    }
+    MPI_Gatherv(stream_runs, nvalues, MPI_UINT64_T, stream_all_runs, stream_counts, stream_displs, MPI_UINT64_T, 0,
+                cart_comm);
+
+    // the runs of the blocks of a row of the process grid interleave
+    if (rank == 0)
+    {
+        qsort(stream_all_runs, total / 2, 2 * sizeof(uint64_t), compare_runs);
+        stream_begin(&stream, iter, key);
+        for (int i = 0; i < total; i += 2)
+            stream_run(&stream, stream_all_runs[i], stream_all_runs[i + 1]);
+        stream_end(&stream);
+    }
+    stream_last = iter;
+}
+
+// print what was asked for generation iter, given the range of the iterations
+// that the ranks found it equal to and the fingerprint of the whole world,
+// returns the iteration if it is a cycle
+static int
+report_iteration(int iter, const int cycle_range[2], uint64_t fingerprint)
+{
+    partial_world *partial_world = &partial_worlds[iter % HISTORY];
+
+    // if all ranks are in the same cycle, then the whole world is in a cycle
+    int cycle = cycle_range[0] == -cycle_range[1] ? cycle_range[0] : 0;
+
+    // the generation before iter is still held, the speculative one took the third slot
+    if (stream_file != NULL)
+        stream_generation(iter, partial_world, &partial_worlds[(iter - 1) % HISTORY]);
+
+    // longer periods, all ranks take the same decisions from the same fingerprint
+    if (!cycle && cycle_detector_due(&cycles, iter))
+    {
+        int equal = partial_world_equal_snapshot(partial_world);
+
+        MPI_Allreduce(MPI_IN_PLACE, &equal, 1, MPI_INT, MPI_LAND, cart_comm);
+        cycles.pending_period = 0;
+        if (equal)
+            cycle = cycles.pending_iter;
+    }
+    if (!cycle && cycle_detector_candidate(&cycles, iter, fingerprint, HISTORY))
+    {
+        if (cycle_snapshot == NULL)
+            cycle_snapshot = alloc_2d_int_array(partial_world_rows + 2, partial_world_cols + 2);
+        for (int row = 1; row <= partial_world_rows; row++)
+            memcpy(&cycle_snapshot[row][1], &partial_world->cells[row][1], partial_world_cols * sizeof(int));
+    }
+
+    if (rank == 0 && cycle)
+        output_printf("world iteration %d is equal to iteration %d\n", iter, cycle);
+
+    // the live counts come from the time step, only they are reduced
+    if (print_cells > 0 && (iter % print_cells) == (print_cells - 1))
+    {
+        int live;
+
+        MPI_Reduce(&partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, cart_comm);
+        if (rank == 0)
+            output_printf("%d: %d live cells\n", iter, live);
+    }
+
+    if (print_world > 0 && (iter % print_world) == (print_world - 1))
+    {
+        if (rank == 0)
+            output_printf("\nat time step %d:\n\n", iter);
+        output_world(partial_world);
+    }
+
+    if (cycle && print_world > 0)
+        output_world(partial_world);
+
+    return cycle;
+}
+
+/* Checkpoints, in the byte order of the machine: the header, the fingerprint
+ * ring of the cycle detector and then nworlds worlds, generation, the one
+ * before it unless generation is 0, and the cycle snapshot if a candidate is
+ * pending. A world is world_rows rows of world_cols bits, column 1 in the
+ * lowest bit of the first byte of a row. Together with the ring that is all
+ * a run needs to go on exactly as it would have without the restart.
+ */
+#define CHECKPOINT_MAGIC "GOLCKPT1"
+
+typedef struct
+{
+    char magic[8];
+    int32_t rows, cols;
+    int32_t generation;
+    int32_t nworlds;
+    uint64_t seed;
+    double density;
+    int32_t ring_length, first, last, rebuilt; // cycle detector state
+    int32_t brent_iter, brent_power, pending_iter, pending_period;
+    uint64_t brent_fingerprint;
+} checkpoint_header;
+
+static size_t
+checkpoint_row_bytes(void)
+{
+    return (world_cols + 7) / 8;
+}
+
+static MPI_Offset
+checkpoint_world_offset(const checkpoint_header *header, int w)
+{
+    return sizeof(checkpoint_header) + (MPI_Offset)header->ring_length * sizeof(uint64_t) +
+           ((MPI_Offset)w * world_rows + partial_world_start) * checkpoint_row_bytes();
+}
+
+// the ranks of a row of blocks of the grid gather their rows at its first rank,
+// which packs them and writes them, so no two ranks write into the same byte
+static void
+checkpoint_write_world(MPI_File fh, MPI_Offset offset, int **cells, MPI_Comm grid_row_comm)
+{
+    size_t row_bytes = checkpoint_row_bytes();
+    int *row_cells = NULL, *counts = NULL, *displs = NULL;
+    unsigned char *bits = NULL;
+    int count = 0;
+
+    for (int i = 1; i <= partial_world_rows; i++)
+        memcpy(&gather_block[(i - 1) * partial_world_cols], &cells[i][1], partial_world_cols * sizeof(int));
+
+    if (coords[1] == 0)
+    {
+        row_cells = malloc((size_t)partial_world_rows * world_cols * sizeof(int));
+        bits = calloc((size_t)partial_world_rows * row_bytes, 1);
+        counts = malloc(dims[1] * sizeof(int));
+        displs = malloc(dims[1] * sizeof(int));
+        if (row_cells == NULL || bits == NULL || counts == NULL || displs == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (int c = 0; c < dims[1]; c++)
+        {
+            int col_start, ncols;
+
+            split_range(world_cols, dims[1], c, &col_start, &ncols);
+            counts[c] = partial_world_rows * ncols;
+            displs[c] = partial_world_rows * col_start;
+        }
+    }
+
+    MPI_Gatherv(gather_block, partial_world_rows * partial_world_cols, MPI_INT,
+                row_cells, counts, displs, MPI_INT, 0, grid_row_comm);
+
+    if (coords[1] == 0)
+    {
+        for (int c = 0; c < dims[1]; c++)
+        {
+            int col_start, ncols;
+
+            split_range(world_cols, dims[1], c, &col_start, &ncols);
+            for (int i = 0; i < partial_world_rows; i++)
+                for (int j = 0; j < ncols; j++)
+                    if (row_cells[displs[c] + i * ncols + j])
+                        bits[i * row_bytes + (col_start + j) / 8] |= 1 << ((col_start + j) % 8);
+        }
+        count = partial_world_rows * row_bytes;
+    }
+
+    MPI_File_write_at_all(fh, offset, bits, count, MPI_BYTE, MPI_STATUS_IGNORE);
+
+    free(row_cells);
+    free(bits);
+    free(counts);
+    free(displs);
+}
+
+// every rank reads the whole rows of its block and keeps its own columns
+static void
+checkpoint_read_world(MPI_File fh, MPI_Offset offset, int **cells)
+{
+    size_t row_bytes = checkpoint_row_bytes();
+    unsigned char *bits = malloc((size_t)partial_world_rows * row_bytes);
+
+    if (bits == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    MPI_File_read_at_all(fh, offset, bits, partial_world_rows * row_bytes, MPI_BYTE, MPI_STATUS_IGNORE);
+
+    for (int i = 1; i <= partial_world_rows; i++)
+        for (int j = 1; j <= partial_world_cols; j++)
+        {
+            int col = partial_world_col_start + j - 1;
+
+            cells[i][j] = (bits[(i - 1) * row_bytes + col / 8] >> (col % 8)) & 1;
+        }
+
+    free(bits);
+}
+
+// write generation iter after it has been reported, the partial world of
+// iter - 1 is still in the history then; the file only replaces an older
+// checkpoint once it is complete
+static void
+checkpoint_write(int iter)
+{
+    checkpoint_header header;
+    char *tmp_file = malloc(strlen(checkpoint_file) + 5);
+    MPI_Comm grid_row_comm;
+    MPI_File fh;
+    int w = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+    header.rows = world_rows;
+    header.cols = world_cols;
+    header.generation = iter;
+    header.nworlds = 1 + (iter > 0) + (cycles.pending_period != 0);
+    header.seed = rng_seed;
+    header.density = rng_density;
+    header.ring_length = cycles.length;
+    header.first = cycles.first;
+    header.last = cycles.last;
+    header.rebuilt = cycles.rebuilt;
+    header.brent_iter = cycles.brent_iter;
+    header.brent_power = cycles.brent_power;
+    header.pending_iter = cycles.pending_iter;
+    header.pending_period = cycles.pending_period;
+    header.brent_fingerprint = cycles.brent_fingerprint;
+
+    sprintf(tmp_file, "%s.tmp", checkpoint_file);
+    if (MPI_File_open(cart_comm, tmp_file, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+            fprintf(stderr, "cannot write checkpoint %s\n", tmp_file);
+        MPI_Abort(cart_comm, 1);
+    }
+    MPI_File_set_size(fh, 0);
+    if (rank == 0)
+    {
+        MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at(fh, sizeof(header), cycles.ring, cycles.length, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    }
+
+    MPI_Comm_split(cart_comm, coords[0], coords[1], &grid_row_comm);
+    checkpoint_write_world(fh, checkpoint_world_offset(&header, w++), partial_worlds[iter % HISTORY].cells, grid_row_comm);
+    if (iter > 0)
+        checkpoint_write_world(fh, checkpoint_world_offset(&header, w++), partial_worlds[(iter - 1) % HISTORY].cells, grid_row_comm);
+    if (cycles.pending_period != 0)
+        checkpoint_write_world(fh, checkpoint_world_offset(&header, w++), cycle_snapshot, grid_row_comm);
+    MPI_Comm_free(&grid_row_comm);
+
+    MPI_File_close(&fh);
+    MPI_Barrier(cart_comm);
+    if (rank == 0 && rename(tmp_file, checkpoint_file) != 0)
+        fprintf(stderr, "cannot rename checkpoint %s\n", tmp_file);
+    free(tmp_file);
+}
+
+// read the header, before the cycle detector is set up with its ring length
+static MPI_File
+checkpoint_open(checkpoint_header *header)
+{
+    MPI_File fh;
 
+    if (MPI_File_open(cart_comm, restart_file, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
         if (rank == 0)
+            fprintf(stderr, "cannot open checkpoint %s\n", restart_file);
+        MPI_Abort(cart_comm, 1);
+    }
+    MPI_File_read_at_all(fh, 0, header, sizeof(*header), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, 8) != 0 || header->rows != world_rows || header->cols != world_cols)
+    {
+        if (rank == 0)
+            fprintf(stderr, "%s is not a checkpoint of a %d x %d world\n", restart_file, world_rows, world_cols);
+        MPI_Abort(cart_comm, 1);
+    }
+
+    return fh;
+}
+
+// restore the cycle detector and the partial worlds of generation and the
+// one before, with their ghost cells, as the time step loop left them
+static void
+checkpoint_restore(MPI_File fh, const checkpoint_header *header)
+{
+    int w = 0;
+
+    MPI_File_read_at_all(fh, sizeof(*header), cycles.ring, cycles.length, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    cycles.first = header->first;
+    cycles.last = header->last;
+    cycles.brent_iter = header->brent_iter;
+    cycles.brent_power = header->brent_power;
+    cycles.brent_fingerprint = header->brent_fingerprint;
+    cycles.pending_iter = header->pending_iter;
+    cycles.pending_period = header->pending_period;
+    if (cycles.length > 0 && cycles.first >= 0)
+        cycle_detector_reindex(&cycles);
+    cycles.rebuilt = header->rebuilt;
+
+    world_iter = header->generation;
+    for (int g = world_iter; g >= 0 && g >= world_iter - 1; g--)
+    {
+        partial_world *partial_world = &partial_worlds[g % HISTORY];
+
+        checkpoint_read_world(fh, checkpoint_world_offset(header, w++), partial_world->cells);
+        partial_world->fingerprint = partial_world_fingerprint(partial_world);
+        partial_world->live = partial_world_count(partial_world);
+        partial_world_border_wrap(partial_world);
+    }
+    if (cycles.pending_period != 0)
+    {
+        cycle_snapshot = alloc_2d_int_array(partial_world_rows + 2, partial_world_cols + 2);
+        checkpoint_read_world(fh, checkpoint_world_offset(header, w++), cycle_snapshot);
+    }
+
+    MPI_File_close(&fh);
+}
+
+static void
+usage(char *prog)
+{
+    if (rank == 0)
+        fprintf(stderr, "Usage: %s [-k auto|scalar|sse2|avx2|avx512] [-t threads] [-g auto|RxC] [-d depth] [-x isend|persistent|neighbor|shared|pscw|fence] [-H ring] [-f] [-s seed] [-p probability] [-i pattern] [-c checkpoint] [-C every] [-r checkpoint] [-z scale] [-F frames] [-o stream] [-K keyframes] [-a] rows cols steps worldstep cellstep\n", prog);
+    MPI_Finalize();
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    // only the master thread calls MPI, between the parallel loops
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int h, nsteps, opt;
+    double start_time, end_time, elapsed_time;
+    const char *kernel = "auto";
+    const char *grid = "auto";
+
+    /* Get Parameters */
+    while ((opt = getopt(argc, argv, "k:t:g:d:x:H:fs:p:i:c:C:r:z:F:o:K:a")) != -1)
+    {
+        switch (opt)
         {
-            for (int i = 1; i < size; i++)
-                MPI_Send(&cycle, 1, MPI_INT, i, 0, MPI_COMM_WORLD);
-            if (cycle)
+        case 'k':
+            kernel = optarg;
+            break;
+        case 't':
+#ifdef _OPENMP
+            omp_set_num_threads(atoi(optarg));
+#else
+            if (rank == 0)
+                fprintf(stderr, "built without OpenMP, -t is ignored\n");
+#endif
+            break;
+        case 'g':
+            grid = optarg;
+            break;
+        case 'd':
+            halo_depth = atoi(optarg);
+            break;
+        case 'H':
+            cycle_ring = atoi(optarg);
+            if (cycle_ring < 0)
+                usage(argv[0]);
+            break;
+        case 'f':
+            fast_forward = 1;
+            break;
+        case 's':
+            rng_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            rng_density = atof(optarg);
+            break;
+        case 'i':
+            if (pattern_open(&start_pattern, optarg) != 0)
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            break;
+        case 'c':
+            checkpoint_file = optarg;
+            break;
+        case 'C':
+            checkpoint_every = atoi(optarg);
+            break;
+        case 'r':
+            restart_file = optarg;
+            break;
+        case 'o':
+            stream_file = optarg;
+            break;
+        case 'a':
+            async_output = 1;
+            break;
+        case 'K':
+            stream_key_every = atoi(optarg);
+            if (stream_key_every < 1)
+                usage(argv[0]);
+            break;
+        case 'z':
+            render_scale = atoi(optarg);
+            if (render_scale < 1)
+                usage(argv[0]);
+            break;
+        case 'F':
+            render_frames = optarg;
+            if (!render_frames_check(render_frames))
+                usage(argv[0]);
+            break;
+        case 'x':
+            halo = find_halo_backend(optarg);
+            if (halo == NULL)
             {
-                if (print_world > 0)
-                {
-                    collect_world();
-                    world_print(cur_world);
-                }
-                break;
+                if (rank == 0)
+                    fprintf(stderr, "unknown halo exchange %s\n", optarg);
+                usage(argv[0]);
             }
+            break;
+        default:
+            usage(argv[0]);
         }
+    }
+    if (argc - optind != 5)
+    {
+        usage(argv[0]);
+    }
+    world_rows = atoi(argv[optind]);
+    world_cols = atoi(argv[optind + 1]);
+    nsteps = atoi(argv[optind + 2]);
+    print_world = atoi(argv[optind + 3]);
+    print_cells = atoi(argv[optind + 4]);
+
+    if (row_step_select(kernel) != 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+#ifdef _OPENMP
+    if (provided < MPI_THREAD_FUNNELED && omp_get_max_threads() > 1)
+    {
+        if (rank == 0)
+            fprintf(stderr, "MPI library does not support MPI_THREAD_FUNNELED, using one thread per rank\n");
+        omp_set_num_threads(1);
+    }
+#endif
+
+    // set up the process grid, by default shaped after the world
+    if (strcmp(grid, "auto") == 0)
+        choose_dims(size, world_rows, world_cols, dims);
+    else if (sscanf(grid, "%dx%d", &dims[0], &dims[1]) != 2 || dims[0] < 1 || dims[1] < 1 || dims[0] * dims[1] != size)
+    {
+        if (rank == 0)
+            fprintf(stderr, "process grid %s does not match %d ranks\n", grid, size);
+        usage(argv[0]);
+    }
+    else if (dims[0] > world_rows || dims[1] > world_cols)
+    {
+        if (rank == 0)
+            fprintf(stderr, "process grid %s is larger than the world\n", grid);
+        usage(argv[0]);
+    }
+
+    // every block has to provide the halo of its neighbours
+    if (halo_depth < 1 || halo_depth > world_rows / dims[0] || halo_depth > world_cols / dims[1])
+    {
+        if (rank == 0)
+            fprintf(stderr, "ghost depth %d does not fit blocks of %d x %d cells\n",
+                    halo_depth, world_rows / dims[0], world_cols / dims[1]);
+        usage(argv[0]);
+    }
+
+    int periods[2] = {1, 1};
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &cart_comm);
+    MPI_Comm_rank(cart_comm, &rank);
+    MPI_Cart_coords(cart_comm, rank, 2, coords);
+    MPI_Cart_shift(cart_comm, 0, 1, &north, &south);
+    MPI_Cart_shift(cart_comm, 1, 1, &west, &east);
+
+    // a restart goes on with the ring length and generation of the checkpoint
+    checkpoint_header restart_header;
+    MPI_File restart_fh = MPI_FILE_NULL;
+    if (restart_file != NULL)
+    {
+        restart_fh = checkpoint_open(&restart_header);
+        cycle_ring = restart_header.ring_length;
+        world_iter = restart_header.generation;
+    }
+
+    rng_init();
+    cycle_keys_init(world_rows, world_cols);
+    cycle_detector_init(&cycles, cycle_ring);
+
+    // initialize the partial world
+    split_range(world_rows, dims[0], coords[0], &partial_world_start, &partial_world_rows);
+    partial_world_end = partial_world_start + partial_world_rows - 1;
+    split_range(world_cols, dims[1], coords[1], &partial_world_col_start, &partial_world_cols);
+    partial_world_col_end = partial_world_col_start + partial_world_cols - 1;
+
+    MPI_Type_vector(partial_world_rows, halo_depth, partial_world_cols + 2 * halo_depth, MPI_INT, &column_type);
+    MPI_Type_commit(&column_type);
+
+    for (h = 0; h < HISTORY; h++)
+    {
+        partial_worlds[h].rows = partial_world_rows;
+        partial_worlds[h].cols = partial_world_cols;
+        if (halo->alloc)
+            partial_worlds[h].cells = halo->alloc(h, partial_world_rows, partial_world_cols, halo_depth);
         else
+            partial_worlds[h].cells = alloc_partial_world_cells(partial_world_rows, partial_world_cols, halo_depth);
+    }
+
+    cur_partial_world = &partial_worlds[world_iter % HISTORY];
+
+    // a background thread is only of use when worlds are printed
+    if (async_output && provided < MPI_THREAD_FUNNELED)
+    {
+        if (rank == 0)
+            fprintf(stderr, "MPI library does not support MPI_THREAD_FUNNELED, -a is ignored\n");
+        async_output = 0;
+    }
+    if (print_world == 0)
+        async_output = 0;
+    collect_world_init();
+    if (async_output)
+        output_init();
+
+    if (halo->init)
+        halo->init();
+
+    // only the partial worlds are ever held in full, every rank initializes its own
+    if (restart_file != NULL)
+        checkpoint_restore(restart_fh, &restart_header);
+    else if (start_pattern.data != NULL)
+        partial_world_init_pattern(cur_partial_world);
+    else if (random_world)
+        partial_world_init_random(cur_partial_world);
+    else
+        partial_world_init_fixed(cur_partial_world);
+    pattern_close(&start_pattern);
+
+    if (print_world > 0)
+    {
+        if (rank == 0)
+            output_printf("\ninitial world:\n\n");
+        output_world(cur_partial_world);
+    }
+
+    // the stream starts with a keyframe of generation 0 or of the checkpoint
+    if (stream_file != NULL)
+    {
+        if (rank == 0)
+        {
+            stream_counts = malloc(size * sizeof(int));
+            stream_displs = malloc(size * sizeof(int));
+            if (stream_counts == NULL || stream_displs == NULL)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            if (stream_create(&stream, stream_file, world_rows, world_cols, stream_key_every) != 0)
+                MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        stream_generation(world_iter, cur_partial_world, NULL);
+    }
+
+    if (rank == 0)
+        start_time = time_secs();
+
+    /*  time steps */
+    // the verdict on a generation is reduced while the next one is computed,
+    // that speculative generation is dropped again when a cycle was found
+    int local_cycle[2], cycle_range[2];
+    uint64_t fingerprint;
+    MPI_Request cycle_requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    int stopped = 0; // period of the cycle that stopped the loop
+    int first_iter = world_iter; // 0, or the generation of the checkpoint
+
+    if (restart_file == NULL)
+    {
+        cur_partial_world->fingerprint = partial_world_fingerprint(cur_partial_world);
+        cur_partial_world->live = partial_world_count(cur_partial_world);
+        MPI_Allreduce(&cur_partial_world->fingerprint, &fingerprint, 1, MPI_UINT64_T, MPI_SUM, cart_comm);
+        cycle_detector_record(&cycles, 0, fingerprint);
+    }
+    else if (rank == 0)
+        fprintf(stderr, "restarted at generation %d\n", first_iter);
+
+    partial_world_border_wrap(cur_partial_world);
+    for (world_iter = first_iter + 1; world_iter < nsteps; world_iter++)
+    {
+        partial_world_advance(world_iter);
+        if (async_output)
+            output_progress();
+
+        int cycle = partial_world_check_cycles(cur_partial_world, world_iter);
+
+        if (world_iter > first_iter + 1)
         {
-            int tmp;
-            MPI_Recv(&tmp, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            if (tmp)
+            MPI_Waitall(2, cycle_requests, MPI_STATUSES_IGNORE);
+            int equal_iter = report_iteration(world_iter - 1, cycle_range, fingerprint);
+
+            if (equal_iter)
             {
-                if (print_world > 0)
-                    collect_world();
+                world_iter--;
+                cur_partial_world = &partial_worlds[world_iter % HISTORY];
+                stopped = world_iter - equal_iter;
                 break;
             }
+            if (checkpoint_file != NULL && checkpoint_every > 0 && (world_iter - 1) % checkpoint_every == 0)
+                checkpoint_write(world_iter - 1);
+        }
+
+        // the minimum and maximum of the matched iterations, negated for the maximum
+        local_cycle[0] = cycle;
+        local_cycle[1] = -cycle;
+        MPI_Iallreduce(local_cycle, cycle_range, 2, MPI_INT, MPI_MIN, cart_comm, &cycle_requests[0]);
+        MPI_Iallreduce(&cur_partial_world->fingerprint, &fingerprint, 1, MPI_UINT64_T, MPI_SUM, cart_comm, &cycle_requests[1]);
+    }
+
+    int last_cycle = 0;
+    if (!stopped && world_iter > first_iter + 1)
+    {
+        MPI_Waitall(2, cycle_requests, MPI_STATUSES_IGNORE);
+        last_cycle = report_iteration(world_iter - 1, cycle_range, fingerprint);
+    }
+
+    // a run that ended in a cycle has nothing left to resume
+    if (checkpoint_file != NULL && !stopped && !last_cycle)
+        checkpoint_write(world_iter - 1);
+
+    // the generation that was rolled back to continues on the halo cadence,
+    // its ghost cells are untouched by the dropped speculative step
+    if (stopped && fast_forward)
+    {
+        int left = (nsteps - 1 - world_iter) % stopped;
+
+        if (rank == 0)
+            fprintf(stderr, "period %d, fast forward to generation %d replaying %d generations\n", stopped, nsteps - 1, left);
+        for (int g = 1; g <= left; g++)
+            partial_world_advance(world_iter + g);
+        world_iter = nsteps - 1;
+
+        // the replayed generations are left out, the stream goes on with a keyframe
+        if (stream_file != NULL)
+            stream_generation(world_iter, cur_partial_world, NULL);
+        if (print_world > 0)
+        {
+            if (rank == 0)
+                output_printf("\nat time step %d:\n\n", world_iter);
+            output_world(cur_partial_world);
         }
     }
 
+    if (async_output)
+        output_finish();
+
     if (rank == 0)
     {
         end_time = time_secs();
         elapsed_time = end_time - start_time;
     }
 
-    collect_world();
+    if (stream_file != NULL && rank == 0)
+        stream_close(&stream);
+
+    /*  Iterations are done; sum the number of live cells */
+    int live;
+    MPI_Reduce(&cur_partial_world->live, &live, 1, MPI_INT, MPI_SUM, 0, cart_comm);
 
     if (rank == 0)
     {
-        /*  Iterations are done; sum the number of live cells */
-        printf("Number of live cells = %d\n", world_count(cur_world));
+        printf("Number of live cells = %d\n", live);
         fprintf(stderr, "Game of Life took %10.3f seconds\n", elapsed_time);
+        fprintf(stderr, "step kernel: %s\n", row_step_name);
+#ifdef _OPENMP
+        fprintf(stderr, "%d ranks x %d threads\n", size, omp_get_max_threads());
+#endif
+        fprintf(stderr, "process grid: %d x %d\n", dims[0], dims[1]);
+        fprintf(stderr, "ghost depth: %d\n", halo_depth);
+        fprintf(stderr, "halo exchange: %s\n", halo->name);
     }
 
+    if (halo->finalize)
+        halo->finalize();
+    MPI_Type_free(&column_type);
+    MPI_Comm_free(&cart_comm);
     MPI_Finalize();
 
     return 0;
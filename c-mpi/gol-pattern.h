@@ -0,0 +1,460 @@
+/***********************
+
+Pattern files
+
+A pattern file is memory mapped and parsed in place, so only the pages that
+are touched are read. Three formats are understood:
+
+- RLE: '#' comment lines, a header line "x = cols, y = rows, ...", then runs
+  of 'b' (dead), 'o' (alive) and '$' (end of row), up to '!'
+- plaintext (.cells): '!' comment lines, then one line per row of '.' (dead)
+  and 'O' or '*' (alive)
+- Life 1.06: a "#Life 1.06" line, then one "x y" line per live cell; the
+  smallest x and y are found when the file is opened
+
+The pattern is placed with its top left cell at world row 1, column 1, cells
+outside the world are dropped. pattern_fill reports the live cells of a window
+of world rows and columns only. For RLE and plaintext it starts at the mark
+pat->start, the first row by default, and stops after the last row of the
+window. To find a mark close to its window, gol-par splits the body into
+line-aligned parts with pattern_part, every rank counts the row starts of one
+part with pattern_scan and the ranks combine the counts, so no rank parses
+more than one part and its own rows. Life 1.06 files list cells in any order,
+every reader goes through all of them.
+
+************************/
+
+#ifndef GOL_PATTERN_H
+#define GOL_PATTERN_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum
+{
+    PATTERN_RLE,
+    PATTERN_PLAINTEXT,
+    PATTERN_LIFE106
+};
+
+typedef struct
+{
+    const char *data; // the mapped file, NULL if none is open
+    size_t size;
+    int format;
+    const char *body;     // first line after the header and comments
+    const char *start;    // RLE and plaintext: pattern_fill starts here, at column 1
+    long start_row;       // of the row at start
+    long min_x, min_y;    // Life 1.06 only, coordinates of world cell (1, 1)
+} pattern;
+
+// a place in the body where row starts at column 1
+typedef struct
+{
+    const char *pos;
+    long row; // 0 if there is no mark
+} pattern_mark;
+
+// a live cell at world row, col
+typedef void (*pattern_set_fn)(void *ctx, int row, int col);
+
+// start of the line after p, or end
+static const char *
+pattern_next_line(const char *p, const char *end)
+{
+    const char *nl = memchr(p, '\n', end - p);
+
+    return nl != NULL ? nl + 1 : end;
+}
+
+static const char *
+pattern_skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+// parse a possibly negative decimal number at *pp, returns 0 if there is none
+static int
+pattern_number(const char **pp, const char *end, long *value)
+{
+    const char *p = pattern_skip_blanks(*pp, end);
+    int negative = 0;
+    long v = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p++ == '-';
+    }
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return 0;
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        v = 10 * v + (*p++ - '0');
+    }
+    *pp = p;
+    *value = negative ? -v : v;
+    return 1;
+}
+
+// map the file and find its format, returns -1 with a message on errors
+static int
+pattern_open(pattern *pat, const char *path)
+{
+    const char *p, *q, *end;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "cannot open pattern %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size == 0)
+    {
+        fprintf(stderr, "pattern %s is empty\n", path);
+        close(fd);
+        return -1;
+    }
+    pat->size = st.st_size;
+    pat->data = mmap(NULL, pat->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pat->data == MAP_FAILED)
+    {
+        fprintf(stderr, "cannot map pattern %s\n", path);
+        pat->data = NULL;
+        return -1;
+    }
+    // the rows are read in order
+    madvise((void *)pat->data, pat->size, MADV_SEQUENTIAL);
+
+    p = pat->data;
+    end = pat->data + pat->size;
+
+    if (pat->size >= 10 && memcmp(p, "#Life 1.06", 10) == 0)
+    {
+        int have_min = 0;
+        long x, y;
+
+        pat->format = PATTERN_LIFE106;
+        pat->body = pattern_next_line(p, end);
+        pat->start = pat->body;
+        pat->start_row = 1;
+        pat->min_x = pat->min_y = 0;
+        for (p = pat->body; p < end; p = pattern_next_line(p, end))
+        {
+            const char *q = p;
+
+            // #D, #N and other comment lines may come anywhere
+            if (*p == '#')
+            {
+                continue;
+            }
+            if (pattern_number(&q, end, &x) && pattern_number(&q, end, &y))
+            {
+                if (!have_min || x < pat->min_x)
+                {
+                    pat->min_x = x;
+                }
+                if (!have_min || y < pat->min_y)
+                {
+                    pat->min_y = y;
+                }
+                have_min = 1;
+            }
+        }
+        return 0;
+    }
+
+    // RLE has '#' comments and then its header, plaintext '!' comments
+    while (p < end && (*p == '#' || *p == '!'))
+    {
+        p = pattern_next_line(p, end);
+    }
+    pat->body = p;
+    pat->format = PATTERN_PLAINTEXT;
+    q = pattern_skip_blanks(p, end);
+    if (q < end && *q == 'x')
+    {
+        pat->format = PATTERN_RLE;
+        pat->body = pattern_next_line(p, end);
+    }
+    pat->start = pat->body;
+    pat->start_row = 1;
+
+    return 0;
+}
+
+static void
+pattern_close(pattern *pat)
+{
+    if (pat->data != NULL)
+    {
+        munmap((void *)pat->data, pat->size);
+        pat->data = NULL;
+    }
+}
+
+// the first line start at or after p in the body
+static const char *
+pattern_line_start(const pattern *pat, const char *p)
+{
+    const char *end = pat->data + pat->size;
+
+    if (p <= pat->body)
+    {
+        return pat->body;
+    }
+    if (p >= end)
+    {
+        return end;
+    }
+    return p[-1] == '\n' ? p : pattern_next_line(p, end);
+}
+
+// part index of nparts of the body, [*from, *to), both at line starts
+static inline void
+pattern_part(const pattern *pat, int index, int nparts, const char **from, const char **to)
+{
+    size_t size = pat->data + pat->size - pat->body;
+
+    *from = pattern_line_start(pat, pat->body + size * index / nparts);
+    *to = pattern_line_start(pat, pat->body + size * (index + 1) / nparts);
+}
+
+static void
+pattern_add_mark(const char *pos, long row, long target, pattern_mark *first, pattern_mark *last)
+{
+    if (first->row == 0)
+    {
+        first->pos = pos;
+        first->row = row;
+    }
+    if (row <= target)
+    {
+        last->pos = pos;
+        last->row = row;
+    }
+}
+
+// walk the lines of an RLE or plaintext body that start in [from, to), where
+// row is the row count at from: the number of rows begun before it for
+// plaintext, the row of the cell at from for RLE. Every place after which a
+// row starts at column 1 is a mark, *first is set to the first one and *last
+// to the last one of a row up to target. Returns the row count at to, *ended
+// is set if the pattern ends before to.
+static inline long
+pattern_scan(const pattern *pat, const char *from, const char *to, long row, long target,
+             pattern_mark *first, pattern_mark *last, int *ended)
+{
+    const char *p = from, *end = pat->data + pat->size;
+
+    first->row = last->row = 0;
+    *ended = 0;
+    while (p < to)
+    {
+        const char *line_end = pattern_next_line(p, end);
+
+        // comment lines, like pattern_fill skips them
+        if (*p == (pat->format == PATTERN_RLE ? '#' : '!'))
+        {
+            p = line_end;
+            continue;
+        }
+        if (pat->format == PATTERN_PLAINTEXT)
+        {
+            pattern_add_mark(p, ++row, target, first, last);
+            p = line_end;
+            continue;
+        }
+
+        while (p < line_end)
+        {
+            long n = 1;
+
+            if (*p >= '0' && *p <= '9')
+            {
+                pattern_number(&p, line_end, &n);
+                if (p == line_end)
+                {
+                    break;
+                }
+            }
+            if (*p == '!')
+            {
+                *ended = 1;
+                return row;
+            }
+            else if (*p == '$')
+            {
+                row += n;
+                pattern_add_mark(p + 1, row, target, first, last);
+            }
+            else if (*p == '#')
+            {
+                break;
+            }
+            p++;
+        }
+        p = line_end;
+    }
+
+    return row;
+}
+
+// report run of n live cells of row, starting at col, that fall into the window
+static void
+pattern_run(int row, int col, long n, int first_col, int last_col, pattern_set_fn set, void *ctx)
+{
+    long c;
+
+    for (c = col > first_col ? col : first_col; c < col + n && c <= last_col; c++)
+    {
+        set(ctx, row, c);
+    }
+}
+
+static void
+pattern_fill_rle(const pattern *pat, int first_row, int last_row, int first_col, int last_col,
+                 pattern_set_fn set, void *ctx)
+{
+    const char *p = pat->start, *end = pat->data + pat->size;
+    long row = pat->start_row, col = 1;
+
+    while (p < end && row <= last_row)
+    {
+        long n = 1;
+
+        if (*p >= '0' && *p <= '9')
+        {
+            pattern_number(&p, end, &n);
+            if (p == end)
+            {
+                break;
+            }
+        }
+
+        if (*p == '!')
+        {
+            break;
+        }
+        else if (*p == '$')
+        {
+            row += n;
+            col = 1;
+        }
+        else if (*p == 'b' || *p == '.')
+        {
+            col += n;
+        }
+        else if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))
+        {
+            // every state other than dead counts as alive
+            if (row >= first_row)
+            {
+                pattern_run(row, col, n, first_col, last_col, set, ctx);
+            }
+            col += n;
+        }
+        else if (*p == '#')
+        {
+            p = pattern_next_line(p, end);
+            continue;
+        }
+        p++;
+    }
+}
+
+static void
+pattern_fill_plaintext(const pattern *pat, int first_row, int last_row, int first_col, int last_col,
+                       pattern_set_fn set, void *ctx)
+{
+    const char *p = pat->start, *end = pat->data + pat->size;
+    long row = pat->start_row;
+
+    for (; p < end && row <= last_row; p = pattern_next_line(p, end))
+    {
+        const char *line_end;
+        int col;
+
+        if (*p == '!')
+        {
+            continue;
+        }
+        if (row >= first_row)
+        {
+            line_end = memchr(p, '\n', end - p);
+            if (line_end == NULL)
+            {
+                line_end = end;
+            }
+            for (col = first_col; col <= last_col && p + col - 1 < line_end; col++)
+            {
+                if (p[col - 1] == 'O' || p[col - 1] == '*')
+                {
+                    set(ctx, row, col);
+                }
+            }
+        }
+        row++;
+    }
+}
+
+static void
+pattern_fill_life106(const pattern *pat, int first_row, int last_row, int first_col, int last_col,
+                     pattern_set_fn set, void *ctx)
+{
+    const char *p = pat->body, *end = pat->data + pat->size;
+
+    for (; p < end; p = pattern_next_line(p, end))
+    {
+        const char *q = p;
+        long x, y;
+
+        if (*p != '#' && pattern_number(&q, end, &x) && pattern_number(&q, end, &y))
+        {
+            long row = y - pat->min_y + 1, col = x - pat->min_x + 1;
+
+            if (row >= first_row && row <= last_row && col >= first_col && col <= last_col)
+            {
+                set(ctx, row, col);
+            }
+        }
+    }
+}
+
+// call set for the live cells in world rows first_row..last_row and columns
+// first_col..last_col; Life 1.06 files may report cells out of order and twice
+static void
+pattern_fill(const pattern *pat, int first_row, int last_row, int first_col, int last_col,
+             pattern_set_fn set, void *ctx)
+{
+    switch (pat->format)
+    {
+    case PATTERN_RLE:
+        pattern_fill_rle(pat, first_row, last_row, first_col, last_col, set, ctx);
+        break;
+    case PATTERN_PLAINTEXT:
+        pattern_fill_plaintext(pat, first_row, last_row, first_col, last_col, set, ctx);
+        break;
+    case PATTERN_LIFE106:
+        pattern_fill_life106(pat, first_row, last_row, first_col, last_col, set, ctx);
+        break;
+    }
+}
+
+#endif
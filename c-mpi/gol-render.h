@@ -0,0 +1,242 @@
+/***********************
+
+Rendering worlds
+
+A world is rendered one row at a time: the caller passes the cells of each
+world row, as 0 or 1, to render_row, which adds them to the live counts of the
+current band of render_scale rows. A complete band becomes one output line,
+one character per block of render_scale x render_scale cells, formatted into
+a buffer and written with a single fwrite.
+
+With a scale of 1 a live cell is 'O' and a dead one ' '. With larger scales
+the glyph is picked from render_glyphs by the fraction of live cells in the
+block, rounded up, so a block with any live cell does not look empty. Blocks
+at the right and bottom edges may be smaller.
+
+When render_frames is set, every world goes to a file of its own, named by
+formatting render_frames with the frame number, which starts at 0: a PBM with
+a scale of 1, a PGM with 256 grey levels otherwise, live cells are black.
+Since render_frames comes from the command line and is used as a printf
+format, render_frames_check accepts only names with exactly one %d or %i
+conversion, with flags, width and precision, and %% for a percent sign.
+
+************************/
+
+#ifndef GOL_RENDER_H
+#define GOL_RENDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int render_scale = 1;       // cells per output character or pixel, across and down
+static const char *render_frames;  // printf format of the frame file names, NULL to print text
+
+static const char render_glyphs[] = " .,:-=+*oO";
+
+static struct
+{
+    int cols, out_cols; // world columns and blocks per band
+    int band_rows;      // rows added to the current band
+    int *counts;        // live cells per block of the current band
+    unsigned char *line;
+    int capacity;       // columns the buffers have room for
+    FILE *out;
+    int frame;
+} render;
+
+// nonzero if format is a frame name render_begin can pass to printf
+static int
+render_frames_check(const char *format)
+{
+    int conversions = 0;
+    const char *p;
+
+    for (p = format; *p != '\0'; p++)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+        if (*++p == '%')
+        {
+            continue;
+        }
+        p += strspn(p, "-+ #0");
+        p += strspn(p, "0123456789");
+        if (*p == '.')
+        {
+            p += 1 + strspn(p + 1, "0123456789");
+        }
+        if (*p != 'd' && *p != 'i')
+        {
+            return 0;
+        }
+        conversions++;
+    }
+
+    return conversions == 1;
+}
+
+static void
+render_alloc(int cols)
+{
+    if (cols <= render.capacity)
+    {
+        return;
+    }
+    free(render.counts);
+    free(render.line);
+    render.counts = calloc(cols, sizeof(int));
+    render.line = malloc(cols + 1);
+    if (render.counts == NULL || render.line == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    render.capacity = cols;
+}
+
+// start a world of rows x cols cells
+static void
+render_begin(int rows, int cols)
+{
+    int out_rows;
+
+    if (render_scale < 1)
+    {
+        render_scale = 1;
+    }
+    render.cols = cols;
+    render.out_cols = (cols + render_scale - 1) / render_scale;
+    render.band_rows = 0;
+    render_alloc(cols);
+    memset(render.counts, 0, render.out_cols * sizeof(int));
+
+    if (render_frames == NULL)
+    {
+        render.out = stdout;
+        return;
+    }
+
+    {
+        char path[4096];
+
+        snprintf(path, sizeof(path), render_frames, render.frame++);
+        render.out = fopen(path, "wb");
+        if (render.out == NULL)
+        {
+            fprintf(stderr, "cannot write frame %s\n", path);
+            exit(1);
+        }
+    }
+    out_rows = (rows + render_scale - 1) / render_scale;
+    if (render_scale == 1)
+    {
+        fprintf(render.out, "P4\n%d %d\n", render.out_cols, out_rows);
+    }
+    else
+    {
+        fprintf(render.out, "P5\n%d %d\n255\n", render.out_cols, out_rows);
+    }
+}
+
+// write the current band out and clear its counts
+static void
+render_band(void)
+{
+    int cols = render.cols, scale = render_scale;
+    unsigned char *line = render.line;
+    size_t len;
+    int b;
+
+    if (render.band_rows == 0)
+    {
+        return;
+    }
+
+    if (render_frames != NULL && scale == 1)
+    {
+        // PBM rows are packed 8 pixels to a byte, first pixel in the high bit
+        len = (render.out_cols + 7) / 8;
+        memset(line, 0, len);
+        for (b = 0; b < render.out_cols; b++)
+        {
+            line[b >> 3] |= (render.counts[b] != 0) << (7 - (b & 7));
+        }
+    }
+    else
+    {
+        for (b = 0; b < render.out_cols; b++)
+        {
+            int width = cols - b * scale < scale ? cols - b * scale : scale;
+            int area = width * render.band_rows, count = render.counts[b];
+
+            if (render_frames != NULL)
+            {
+                line[b] = 255 - (count * 255 + area / 2) / area;
+            }
+            else
+            {
+                line[b] = render_glyphs[(count * (int)(sizeof(render_glyphs) - 2) + area - 1) / area];
+            }
+        }
+        len = render.out_cols;
+        if (render_frames == NULL)
+        {
+            line[len++] = '\n';
+        }
+    }
+    fwrite(line, 1, len, render.out);
+
+    memset(render.counts, 0, render.out_cols * sizeof(int));
+    render.band_rows = 0;
+}
+
+// add the next world row, cells[0] is column 1
+static void
+render_row(const int *cells)
+{
+    int cols = render.cols, scale = render_scale;
+    int b, col;
+
+    if (scale == 1)
+    {
+        for (col = 0; col < cols; col++)
+        {
+            render.counts[col] += cells[col];
+        }
+    }
+    else
+    {
+        for (b = 0, col = 0; b < render.out_cols; b++)
+        {
+            int end = col + scale < cols ? col + scale : cols, count = 0;
+
+            for (; col < end; col++)
+            {
+                count += cells[col];
+            }
+            render.counts[b] += count;
+        }
+    }
+
+    if (++render.band_rows == scale)
+    {
+        render_band();
+    }
+}
+
+// finish the world, writes out a partial last band
+static void
+render_end(void)
+{
+    render_band();
+    if (render.out != stdout)
+    {
+        fclose(render.out);
+    }
+    render.out = NULL;
+}
+
+#endif
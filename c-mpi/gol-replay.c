@@ -0,0 +1,132 @@
+/***********************
+
+Replay of a stream file written by gol-seq or gol-par with -o
+
+Prints the worlds of generations first to last, every every-th of them,
+with the same renderer and options as the simulations. The replay seeks to
+first through the keyframe index, so it reads only the last keyframe at or
+before first and the deltas after it.
+
+************************/
+
+#define STREAM_READER
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gol-render.h"
+#include "gol-stream.h"
+
+static void
+stream_print(stream_reader *r, int *row_cells)
+{
+    int rows = r->header.rows, cols = r->header.cols;
+    int row, col;
+
+    render_begin(rows, cols);
+    for (row = 0; row < rows; row++)
+    {
+        for (col = 0; col < cols; col++)
+        {
+            row_cells[col] = r->cells[(size_t)row * cols + col];
+        }
+        render_row(row_cells);
+    }
+    render_end();
+}
+
+static void
+usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-z scale] [-F frames] stream [first [last [every]]]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int first = 0, last = INT_MAX, every = 1;
+    stream_reader r;
+    int *row_cells;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "z:F:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'z':
+            render_scale = atoi(optarg);
+            if (render_scale < 1)
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 'F':
+            render_frames = optarg;
+            if (!render_frames_check(render_frames))
+            {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 4)
+    {
+        usage(argv[0]);
+    }
+    if (argc - optind > 1)
+    {
+        first = atoi(argv[optind + 1]);
+    }
+    if (argc - optind > 2)
+    {
+        last = atoi(argv[optind + 2]);
+    }
+    if (argc - optind > 3)
+    {
+        every = atoi(argv[optind + 3]);
+    }
+    if (first < 0 || every < 1)
+    {
+        usage(argv[0]);
+    }
+
+    if (stream_open(&r, argv[optind]) != 0)
+    {
+        exit(1);
+    }
+    row_cells = malloc(r.header.cols * sizeof(int));
+    if (row_cells == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    if (!stream_seek(&r, first))
+    {
+        fprintf(stderr, "stream has no generation %d or later\n", first);
+        exit(1);
+    }
+    // generations left out by fast forwarding are skipped
+    do
+    {
+        if (r.generation > last)
+        {
+            break;
+        }
+        if ((r.generation - first) % every == 0)
+        {
+            printf("\nat time step %d:\n\n", r.generation);
+            stream_print(&r, row_cells);
+        }
+    } while (stream_next(&r));
+
+    fprintf(stderr, "%d x %d world, %zu keyframes\n", r.header.rows, r.header.cols, r.nkeys);
+    stream_close_reader(&r);
+    free(row_cells);
+
+    return 0;
+}
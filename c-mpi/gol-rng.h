@@ -0,0 +1,77 @@
+/***********************
+
+Counter based random initial worlds
+
+Cell (row, col) of a world with cols columns has the index
+(row - 1) * cols + col - 1 and is alive if the upper 32 bits of
+rng_mix(index) are below density * 2^32. rng_mix is the SplitMix64 output
+function applied to a counter keyed on the seed, so a rank or thread draws
+any cell without drawing the cells before it. The world depends on the seed
+and the density only, not on the number of ranks or threads, nor on libc.
+
+************************/
+
+#ifndef GOL_RNG_H
+#define GOL_RNG_H
+
+#include <stdint.h>
+
+static uint64_t rng_seed = 1;
+static double rng_density = 0.5;
+
+static uint64_t rng_key;       // derived from rng_seed
+static uint64_t rng_threshold; // a cell is alive below it, up to 2^32
+
+static inline uint64_t
+rng_finalize(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// set up the key and threshold from rng_seed and rng_density
+static inline void
+rng_init(void)
+{
+    double density = rng_density < 0 ? 0 : rng_density > 1 ? 1 : rng_density;
+
+    // the key is hashed, so seeds next to each other do not give shifted worlds
+    rng_key = rng_finalize(rng_seed + 0x9e3779b97f4a7c15ULL);
+    rng_threshold = (uint64_t)(density * 4294967296.0);
+}
+
+static inline uint64_t
+rng_mix(uint64_t index)
+{
+    return rng_finalize(rng_key + index * 0x9e3779b97f4a7c15ULL);
+}
+
+// n cells starting at cell index, as 0 or 1
+static inline void
+rng_row(int *cells, uint64_t index, int n)
+{
+    int j;
+
+    for (j = 0; j < n; j++)
+    {
+        cells[j] = (rng_mix(index + j) >> 32) < rng_threshold;
+    }
+}
+
+// up to 64 cells starting at cell index, cell index + j in bit j
+static inline uint64_t
+rng_word(uint64_t index, int n)
+{
+    uint64_t word = 0;
+    int j;
+
+    for (j = 0; j < n; j++)
+    {
+        word |= (uint64_t)((rng_mix(index + j) >> 32) < rng_threshold) << j;
+    }
+
+    return word;
+}
+
+#endif
@@ -6,17 +6,57 @@ Based on https://web.cs.dal.ca/~arc/teaching/CS4125/2014winter/Assignment2/Assig
 
 ************************/
 
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gol-cycle.h"
+#include "gol-pattern.h"
+#include "gol-render.h"
+#include "gol-rng.h"
+#include "gol-simd.h"
+#include "gol-stream.h"
 
 typedef struct
 {
     int rows, cols;
     int **cells;
+    uint64_t fingerprint; // of the interior cells, see gol-cycle.h
 } world;
 
+// bit-packed world: 64 cells per word, column col lives in bit (col - 1) % 64
+// of word 1 + (col - 1) / 64; word 0 and word nwords + 1 are ghost words
+typedef struct
+{
+    int rows, cols;
+    int nwords; // number of words per row, excluding the ghost words
+    uint64_t **words;
+    uint64_t fingerprint;
+} bit_world;
+
+// a world row of cols cells, 0 or 1, column 1 first
+typedef void (*world_row_fn)(const int *cells);
+
+// a simulation engine advances the current world by up to ngens generations,
+// returns how many it did and sets *cycle to the period when a cycle has been detected;
+// all engines but hashlife detect the same cycles, see gol-cycle.h
+typedef struct
+{
+    const char *name;
+    void (*init)(void);
+    int (*advance)(int iter, int ngens, int *cycle);
+    int (*count)(void);
+    void (*emit)(world_row_fn emit); // hands the rows of the current world to emit, top to bottom
+    void (*report)(void); // engine statistics at the end of the run, may be NULL
+} engine;
+
 /* keep short history since we want to detect simple cycles */
 #define HISTORY 3
 
@@ -25,6 +65,22 @@ static int world_iter = 0;
 static int world_rows, world_cols; // 行数和列数
 
 static world *cur_world;
+static int *row_cells; // one world row, for the engines that do not keep rows of ints
+
+static bit_world bit_worlds[HISTORY];
+static bit_world *cur_bit_world;
+
+// periods beyond HISTORY are found by fingerprint and confirmed against a
+// snapshot one period later
+static cycle_detector cycles;
+static int cycle_ring = 4096;
+static world cycle_snapshot;
+static bit_world bit_cycle_snapshot;
+
+// with -f a cycle does not end the run, the generations left are reduced
+// modulo the period and only those are replayed
+static int fast_forward = 0;
+static int fast_forwarding = 0; // replaying, cycles are not reported again
 
 static int print_cells = 0; // 每隔多少步打印一次活细胞数
 static int print_world = 0; // 每隔多少步打印一次世界
@@ -36,6 +92,18 @@ static int random_world = 0;
 static int random_world = 1;
 #endif
 
+// a pattern file given with -i replaces the random or fixed world
+static pattern start_pattern;
+
+// -o records every generation to a stream file, with a keyframe every -K
+// generations; the previous generation is kept bit-packed to find the flips
+static const char *stream_file;
+static int stream_key_every = 100;
+static stream_writer stream;
+static uint64_t *stream_world; // stream_words words per row, column col in bit (col - 1) % 64
+static int stream_words;
+static int stream_row_index; // row of the next stream_row, from 0
+
 static char *start_world[] = {
     /* Gosper glider gun */
     /* example from https://bitstorm.org/gameoflife/ */
@@ -63,6 +131,79 @@ static char *start_world[] = {
     "..........................................",
 };
 
+static int **
+alloc_2d_int_array(int nrows, int ncolumns)
+{
+    int **array;
+    int row;
+
+    /* version that keeps the 2d data contiguous, can help caching and slicing across dimensions */
+    array = malloc(nrows * sizeof(int *));
+    if (array == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    array[0] = malloc((size_t)nrows * ncolumns * sizeof(int));
+    if (array[0] == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* memory layout is row-major */
+    for (row = 1; row < nrows; row++)
+    {
+        array[row] = array[0] + (size_t)row * ncolumns;
+    }
+
+    /* first touch in the row bands the threads work on later, so that the
+     * pages of each band end up on the NUMA node of the thread using them */
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < nrows; row++)
+    {
+        memset(array[row], 0, ncolumns * sizeof(int));
+    }
+
+    return array;
+}
+
+static uint64_t **
+alloc_2d_word_array(int nrows, int ncolumns)
+{
+    uint64_t **array;
+    int row;
+
+    /* same contiguous layout as alloc_2d_int_array */
+    array = malloc(nrows * sizeof(uint64_t *));
+    if (array == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    array[0] = malloc((size_t)nrows * ncolumns * sizeof(uint64_t));
+    if (array[0] == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (row = 1; row < nrows; row++)
+    {
+        array[row] = array[0] + (size_t)row * ncolumns;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (row = 0; row < nrows; row++)
+    {
+        memset(array[row], 0, ncolumns * sizeof(uint64_t));
+    }
+
+    return array;
+}
+
 static void
 world_init_fixed(world *world)
 {
@@ -89,52 +230,45 @@ world_init_fixed(world *world)
 }
 
 static void
-world_init_random(world *world)
+world_set_cell(void *ctx, int row, int col)
 {
-    int **cells = world->cells;
-    int row, col;
+    ((world *)ctx)->cells[row][col] = 1;
+}
 
-    // Note that rand() implementation is platform dependent.
-    // At least make it reprodible on this platform by means of srand()
-    srand(1);
+static void
+world_init_pattern(world *world)
+{
+    int row;
 
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            float x = rand() / ((float)RAND_MAX + 1);
-            if (x < 0.5)
-            {
-                cells[row][col] = 0;
-            }
-            else
-            {
-                cells[row][col] = 1;
-            }
-        }
+        memset(&world->cells[row][1], 0, world->cols * sizeof(int));
     }
+    pattern_fill(&start_pattern, 1, world->rows, 1, world->cols, world_set_cell, world);
 }
 
 static void
-world_print(world *world)
+world_init_random(world *world)
 {
     int **cells = world->cells;
-    int row, col;
+    int row;
 
+    // every row is drawn on its own, see gol-rng.h
+#pragma omp parallel for schedule(static)
     for (row = 1; row <= world->rows; row++)
     {
-        for (col = 1; col <= world->cols; col++)
-        {
-            if (cells[row][col])
-            {
-                printf("O");
-            }
-            else
-            {
-                printf(" ");
-            }
-        }
-        printf("\n");
+        rng_row(&cells[row][1], (uint64_t)(row - 1) * world->cols, world->cols);
+    }
+}
+
+static void
+world_emit(world *world, world_row_fn emit)
+{
+    int row;
+
+    for (row = 1; row <= world->rows; row++)
+    {
+        emit(&world->cells[row][1]);
     }
 }
 
@@ -146,6 +280,7 @@ world_count(world *world)
     int row, col;
 
     isum = 0;
+#pragma omp parallel for schedule(static) private(col) reduction(+ : isum)
     for (row = 1; row <= world->rows; row++)
     {
         for (col = 1; col <= world->cols; col++)
@@ -165,6 +300,7 @@ world_border_wrap(world *world)
     int row, col;
 
     /* left-right boundary conditions */
+#pragma omp parallel for schedule(static)
     for (row = 1; row <= world->rows; row++)
     {
         cells[row][0] = cells[row][world->cols];
@@ -172,6 +308,7 @@ world_border_wrap(world *world)
     }
 
     /* top-bottom boundary conditions */
+#pragma omp parallel for schedule(static)
     for (col = 0; col <= world->cols + 1; col++)
     {
         cells[0][col] = cells[world->rows][col];
@@ -186,195 +323,2398 @@ static void
 world_timestep(world *old, world *new)
 {
     int **cells = old->cells;
-    int row, col;
+    int row;
+
+    uint64_t fingerprint = 0;
 
-    // update board
+    // update board, one row at a time with the selected row kernel,
+    // the threads take the same row bands they first touched in alloc_2d_int_array;
+    // the fingerprint is taken while the new row is still in cache
+#pragma omp parallel for schedule(static) reduction(+ : fingerprint)
     for (row = 1; row <= new->rows; row++)
     {
-        for (col = 1; col <= new->cols; col++)
-        {
-            int row_m, row_p, col_m, col_p, nsum;
-            int newval;
-
-            // sum surrounding cells
-            row_m = row - 1;
-            row_p = row + 1;
-            col_m = col - 1;
-            col_p = col + 1;
-
-            nsum = cells[row_p][col_m] + cells[row_p][col] + cells[row_p][col_p] + cells[row][col_m] + cells[row][col_p] + cells[row_m][col_m] + cells[row_m][col] + cells[row_m][col_p];
+        row_step(&cells[row - 1][1], &cells[row][1], &cells[row + 1][1], &new->cells[row][1], new->cols);
+        fingerprint += cycle_row_fingerprint(row, 1, &new->cells[row][1], new->cols);
+    }
+    new->fingerprint = fingerprint;
+}
 
-            switch (nsum)
-            {
-            case 3:
-                // a new cell is born
-                newval = 1;
-                break;
-            case 2:
-                // the cell, if any, survives
-                newval = cells[row][col];
-                break;
-            default:
-                // the cell, if any, dies
-                newval = 0;
-                break;
-            }
+static uint64_t
+world_fingerprint(world *world)
+{
+    uint64_t fingerprint = 0;
+    int row;
 
-            new->cells[row][col] = newval;
-        }
+#pragma omp parallel for schedule(static) reduction(+ : fingerprint)
+    for (row = 1; row <= world->rows; row++)
+    {
+        fingerprint += cycle_row_fingerprint(row, 1, &world->cells[row][1], world->cols);
     }
+
+    return fingerprint;
 }
 
+// compare the interior cells of two worlds, in row bands
 static int
-world_check_cycles(world *cur_world, int iter)
+world_equal(world *a, world *b)
 {
-    int i;
+    int differ = 0;
+    int row;
 
-    /* This version re-applies the border wraps so they are consistent with
-     * the respective world states, and we can just compare the full world arrays.
-     */
-    world_border_wrap(cur_world);
-    for (i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
+#pragma omp parallel for schedule(static) reduction(| : differ)
+    for (row = 1; row <= world_rows; row++)
     {
-        world *prev_world = &worlds[i % HISTORY];
-
-        world_border_wrap(prev_world);
-        if (memcmp(&cur_world->cells[0][0], &prev_world->cells[0][0],
-                   (world_rows + 2) * (world_cols + 2) * sizeof(int)) == 0)
-        {
-            printf("world iteration %d is equal to iteration %d\n", iter, i);
-            return 1;
-        }
+        differ |= memcmp(&a->cells[row][1], &b->cells[row][1], world_cols * sizeof(int)) != 0;
     }
 
-    return 0;
+    return !differ;
 }
 
-static int **
-alloc_2d_int_array(int nrows, int ncolumns)
+static void
+world_copy(world *dst, world *src)
 {
-    int **array;
     int row;
 
-    /* version that keeps the 2d data contiguous, can help caching and slicing across dimensions */
-    array = malloc(nrows * sizeof(int *));
-    if (array == NULL)
+#pragma omp parallel for schedule(static)
+    for (row = 1; row <= world_rows; row++)
     {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
+        memcpy(&dst->cells[row][1], &src->cells[row][1], world_cols * sizeof(int));
     }
+}
 
-    array[0] = malloc(nrows * ncolumns * sizeof(int));
-    if (array[0] == NULL)
+// generation iter repeats generation i, returns the period
+static int
+cycle_found(int iter, int i)
+{
+    if (!fast_forwarding)
     {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
+        printf("world iteration %d is equal to iteration %d\n", iter, i);
     }
+    return iter - i;
+}
 
-    /* memory layout is row-major */
-    for (row = 1; row < nrows; row++)
+static void
+world_take_snapshot(world *cur_world)
+{
+    if (cycle_snapshot.cells == NULL)
     {
-        array[row] = array[0] + row * ncolumns;
+        cycle_snapshot.cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
     }
-
-    return array;
+    world_copy(&cycle_snapshot, cur_world);
 }
 
-static double
-time_secs(void)
+// the periods of at least history generations, through the fingerprint ring
+// and a snapshot that is compared one period later; the engines check the
+// shorter periods themselves
+static int
+world_check_long_cycles(world *cur_world, int iter, int history)
 {
-    struct timeval tv;
+    if (cycle_detector_due(&cycles, iter))
+    {
+        cycles.pending_period = 0;
+        if (world_equal(cur_world, &cycle_snapshot))
+        {
+            return cycle_found(iter, cycles.pending_iter);
+        }
+    }
 
-    if (gettimeofday(&tv, 0) != 0)
+    if (cycle_detector_candidate(&cycles, iter, cur_world->fingerprint, history))
     {
-        fprintf(stderr, "could not do timing\n");
-        exit(1);
+        world_take_snapshot(cur_world);
     }
 
-    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+    return 0;
 }
 
-int main(int argc, char *argv[])
+static int
+world_check_cycles(world *cur_world, int iter)
 {
-    int h, nsteps;
-    double start_time, end_time, elapsed_time;
+    int i;
 
-    /* Get Parameters */
-    if (argc != 6)
+    /* Only worlds with the same fingerprint are compared, the ones in the
+     * history right away, older ones through a snapshot one period later.
+     */
+    for (i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
     {
-        fprintf(stderr, "Usage: %s rows cols steps worldstep cellstep\n", argv[0]);
-        exit(1);
-    }
-    world_rows = atoi(argv[1]);
-    world_cols = atoi(argv[2]);
-    nsteps = atoi(argv[3]);
-    print_world = atoi(argv[4]);
-    print_cells = atoi(argv[5]);
+        world *prev_world = &worlds[i % HISTORY];
 
-    /* initialize worlds, when allocating arrays, add 2 for ghost cells in both directorions */
-    for (h = 0; h < HISTORY; h++)
-    {
-        worlds[h].rows = world_rows;
-        worlds[h].cols = world_cols;
-        worlds[h].cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
+        if (prev_world->fingerprint == cur_world->fingerprint && world_equal(cur_world, prev_world))
+        {
+            return cycle_found(iter, i);
+        }
     }
 
-    /*  initialize board */
-    cur_world = &worlds[world_iter % HISTORY];
-    if (random_world)
+    return world_check_long_cycles(cur_world, iter, HISTORY);
+}
+
+static void
+bit_world_set(bit_world *world, int row, int col, int val)
+{
+    uint64_t *word = &world->words[row][1 + (col - 1) / 64];
+    uint64_t bit = (uint64_t)1 << ((col - 1) % 64);
+
+    if (val)
     {
-        world_init_random(cur_world);
+        *word |= bit;
     }
     else
     {
-        world_init_fixed(cur_world);
+        *word &= ~bit;
     }
+}
 
-    if (print_world > 0)
+static int
+bit_world_get(bit_world *world, int row, int col)
+{
+    return (world->words[row][1 + (col - 1) / 64] >> ((col - 1) % 64)) & 1;
+}
+
+// mask of the valid bits in the last word of a row
+static uint64_t
+bit_world_last_mask(bit_world *world)
+{
+    int nbits = world->cols % 64;
+
+    return nbits ? ((uint64_t)1 << nbits) - 1 : ~(uint64_t)0;
+}
+
+static void
+bit_world_init_fixed(bit_world *world)
+{
+    int row, col;
+
+    /* use predefined start_world, same as world_init_fixed */
+
+    for (row = 1; row <= world->rows; row++)
     {
-        printf("\ninitial world:\n\n");
-        world_print(cur_world);
+        memset(world->words[row], 0, (world->nwords + 2) * sizeof(uint64_t));
+        for (col = 1; col <= world->cols; col++)
+        {
+            if ((row <= sizeof(start_world) / sizeof(char *)) &&
+                (col <= strlen(start_world[row - 1])))
+            {
+                bit_world_set(world, row, col, start_world[row - 1][col - 1] != '.');
+            }
+        }
     }
+}
 
-    start_time = time_secs();
+static void
+bit_world_set_cell(void *ctx, int row, int col)
+{
+    bit_world_set((bit_world *)ctx, row, col, 1);
+}
 
-    /*  time steps */
-    for (world_iter = 1; world_iter < nsteps; world_iter++)
-    {
-        world *next_world;
-        int cycle;
+static void
+bit_world_init_pattern(bit_world *world)
+{
+    int row;
 
-        next_world = &worlds[world_iter % HISTORY];
+    for (row = 1; row <= world->rows; row++)
+    {
+        memset(world->words[row], 0, (world->nwords + 2) * sizeof(uint64_t));
+    }
+    pattern_fill(&start_pattern, 1, world->rows, 1, world->cols, bit_world_set_cell, world);
+}
 
-        world_border_wrap(cur_world);
-        world_timestep(cur_world, next_world);
-        cur_world = next_world;
+static void
+bit_world_init_random(bit_world *world)
+{
+    int row;
 
-        cycle = world_check_cycles(cur_world, world_iter);
+    // the same cells as world_init_random, drawn a whole word at a time
+#pragma omp parallel for schedule(static)
+    for (row = 1; row <= world->rows; row++)
+    {
+        int h;
 
-        if (print_cells > 0 && (world_iter % print_cells) == (print_cells - 1))
+        memset(world->words[row], 0, (world->nwords + 2) * sizeof(uint64_t));
+        for (h = 0; h < world->nwords; h++)
         {
-            printf("%d: %d live cells\n", world_iter, world_count(cur_world));
-        }
+            int n = world->cols - 64 * h < 64 ? world->cols - 64 * h : 64;
 
-        if (print_world > 0 && (cycle || (world_iter % print_world) == (print_world - 1)))
-        {
-            printf("\nat time step %d:\n\n", world_iter);
-            world_print(cur_world);
+            world->words[row][1 + h] = rng_word((uint64_t)(row - 1) * world->cols + 64 * h, n);
         }
+    }
+}
 
-        if (cycle)
+static void
+bit_world_emit(bit_world *world, world_row_fn emit)
+{
+    int row, col;
+
+    for (row = 1; row <= world->rows; row++)
+    {
+        for (col = 1; col <= world->cols; col++)
         {
-            break;
+            row_cells[col - 1] = bit_world_get(world, row, col);
+        }
+        emit(row_cells);
+    }
+}
+
+static int
+bit_world_count(bit_world *world)
+{
+    uint64_t mask = bit_world_last_mask(world);
+    int isum;
+    int row, w;
+
+    isum = 0;
+#pragma omp parallel for schedule(static) private(w) reduction(+ : isum)
+    for (row = 1; row <= world->rows; row++)
+    {
+        uint64_t *words = world->words[row];
+
+        for (w = 1; w < world->nwords; w++)
+        {
+            isum = isum + __builtin_popcountll(words[w]);
+        }
+        isum = isum + __builtin_popcountll(words[world->nwords] & mask);
+    }
+
+    return isum;
+}
+
+/* Take world wrap-around into account: the left ghost word holds the last
+ * column in its top bit, the first column goes in the bit just past the last
+ * column (which is the bottom bit of the right ghost word if the row is full)
+ */
+static void
+bit_world_border_wrap(bit_world *world)
+{
+    uint64_t mask = bit_world_last_mask(world);
+    int nwords = world->nwords;
+    int row;
+
+    /* left-right boundary conditions */
+    for (row = 1; row <= world->rows; row++)
+    {
+        uint64_t *words = world->words[row];
+        uint64_t first = words[1] & 1;
+        uint64_t last = (uint64_t)bit_world_get(world, row, world->cols);
+
+        words[0] = last << 63;
+        if (world->cols % 64)
+        {
+            words[nwords] = (words[nwords] & mask) | (first << (world->cols % 64));
+            words[nwords + 1] = 0;
+        }
+        else
+        {
+            words[nwords + 1] = first;
+        }
+    }
+
+    /* top-bottom boundary conditions */
+    memcpy(world->words[0], world->words[world->rows], (nwords + 2) * sizeof(uint64_t));
+    memcpy(world->words[world->rows + 1], world->words[1], (nwords + 2) * sizeof(uint64_t));
+}
+
+// fingerprint of one bit-packed row, an odd key per word instead of one per
+// cell, as the bits engine does not hand its fingerprints to another engine
+static uint64_t *bit_word_keys;
+
+static uint64_t
+bit_row_fingerprint(int row, const uint64_t *words, int nwords)
+{
+    uint64_t sum = 0;
+    int w;
+
+    for (w = 1; w <= nwords; w++)
+    {
+        sum += words[w] * bit_word_keys[w];
+    }
+
+    return sum * cycle_row_keys[row];
+}
+
+// update board for next timestep, 64 cells at a time
+// the eight neighbours are summed with bit-parallel adders,
+// so every bit of a word carries its own cell's count
+static void
+bit_world_timestep(bit_world *old, bit_world *new)
+{
+    uint64_t **words = old->words;
+    uint64_t mask = bit_world_last_mask(new);
+    uint64_t fingerprint = 0;
+    int row, w;
+
+#pragma omp parallel for schedule(static) private(w) reduction(+ : fingerprint)
+    for (row = 1; row <= new->rows; row++)
+    {
+        uint64_t *up = words[row - 1];
+        uint64_t *mid = words[row];
+        uint64_t *down = words[row + 1];
+        uint64_t *out = new->words[row];
+
+        for (w = 1; w <= new->nwords; w++)
+        {
+            uint64_t uw, uc, ue, mw, mc, me, dw, dc, de;
+            uint64_t u0, u1, m0, m1, d0, d1, s0, c1, t0, t1;
+
+            // west and east neighbours are the row shifted by one bit
+            uc = up[w];
+            uw = (uc << 1) | (up[w - 1] >> 63);
+            ue = (uc >> 1) | (up[w + 1] << 63);
+            mc = mid[w];
+            mw = (mc << 1) | (mid[w - 1] >> 63);
+            me = (mc >> 1) | (mid[w + 1] << 63);
+            dc = down[w];
+            dw = (dc << 1) | (down[w - 1] >> 63);
+            de = (dc >> 1) | (down[w + 1] << 63);
+
+            // per row sums: two bits for up and down, the centre is not counted in mid
+            u0 = uw ^ uc ^ ue;
+            u1 = (uw & uc) | (ue & (uw ^ uc));
+            m0 = mw ^ me;
+            m1 = mw & me;
+            d0 = dw ^ dc ^ de;
+            d1 = (dw & dc) | (de & (dw ^ dc));
+
+            // nsum = s0 + 2 * (t0 + c1 + 2 * t1)
+            s0 = u0 ^ m0 ^ d0;
+            c1 = (u0 & m0) | (d0 & (u0 ^ m0));
+            t0 = u1 ^ m1 ^ d1;
+            t1 = (u1 & m1) | (d1 & (u1 ^ m1));
+
+            // alive if nsum is 3, or 2 with the cell alive
+            out[w] = ~t1 & (t0 ^ c1) & (s0 | mc);
+        }
+        out[new->nwords] &= mask;
+
+        // the row is still in L1
+        fingerprint += bit_row_fingerprint(row, out, new->nwords);
+    }
+    new->fingerprint = fingerprint;
+}
+
+static uint64_t
+bit_world_fingerprint(bit_world *world)
+{
+    uint64_t fingerprint = 0;
+    int row;
+
+#pragma omp parallel for schedule(static) reduction(+ : fingerprint)
+    for (row = 1; row <= world->rows; row++)
+    {
+        fingerprint += bit_row_fingerprint(row, world->words[row], world->nwords);
+    }
+
+    return fingerprint;
+}
+
+// compare the interior cells only: once a world is border wrapped, the last
+// word of a row also holds column 1 in the bit past the last column
+static int
+bit_world_equal(bit_world *a, bit_world *b)
+{
+    uint64_t mask = bit_world_last_mask(a);
+    int nwords = a->nwords;
+    int differ = 0;
+    int row;
+
+#pragma omp parallel for schedule(static) reduction(| : differ)
+    for (row = 1; row <= world_rows; row++)
+    {
+        differ |= memcmp(&a->words[row][1], &b->words[row][1], (nwords - 1) * sizeof(uint64_t)) != 0;
+        differ |= ((a->words[row][nwords] ^ b->words[row][nwords]) & mask) != 0;
+    }
+
+    return !differ;
+}
+
+static int
+bit_world_check_cycles(bit_world *cur_world, int iter)
+{
+    int i;
+
+    /* same approach as world_check_cycles */
+    for (i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
+    {
+        bit_world *prev_world = &bit_worlds[i % HISTORY];
+
+        if (prev_world->fingerprint == cur_world->fingerprint && bit_world_equal(cur_world, prev_world))
+        {
+            return cycle_found(iter, i);
+        }
+    }
+
+    if (cycle_detector_due(&cycles, iter))
+    {
+        cycles.pending_period = 0;
+        if (bit_world_equal(cur_world, &bit_cycle_snapshot))
+        {
+            return cycle_found(iter, cycles.pending_iter);
+        }
+    }
+
+    if (cycle_detector_candidate(&cycles, iter, cur_world->fingerprint, HISTORY))
+    {
+        if (bit_cycle_snapshot.words == NULL)
+        {
+            bit_cycle_snapshot.nwords = cur_world->nwords;
+            bit_cycle_snapshot.words = alloc_2d_word_array(world_rows + 2, cur_world->nwords + 2);
+        }
+        memcpy(&bit_cycle_snapshot.words[0][0], &cur_world->words[0][0],
+               (size_t)(world_rows + 2) * (cur_world->nwords + 2) * sizeof(uint64_t));
+    }
+
+    return 0;
+}
+
+static double
+time_secs(void)
+{
+    struct timeval tv;
+
+    if (gettimeofday(&tv, 0) != 0)
+    {
+        fprintf(stderr, "could not do timing\n");
+        exit(1);
+    }
+
+    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/* int engine: one int per cell */
+
+static void
+int_engine_alloc(void)
+{
+    int h;
+
+    /* initialize worlds, when allocating arrays, add 2 for ghost cells in both directorions */
+    for (h = 0; h < HISTORY; h++)
+    {
+        worlds[h].rows = world_rows;
+        worlds[h].cols = world_cols;
+        worlds[h].cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
+    }
+}
+
+static void
+int_engine_init(void)
+{
+    int_engine_alloc();
+
+    /*  initialize board */
+    cur_world = &worlds[0];
+    if (start_pattern.data != NULL)
+    {
+        world_init_pattern(cur_world);
+    }
+    else if (random_world)
+    {
+        world_init_random(cur_world);
+    }
+    else
+    {
+        world_init_fixed(cur_world);
+    }
+    cur_world->fingerprint = world_fingerprint(cur_world);
+    cycle_detector_record(&cycles, 0, cur_world->fingerprint);
+}
+
+static int
+int_engine_advance(int iter, int ngens, int *cycle)
+{
+    world *next_world = &worlds[iter % HISTORY];
+
+    world_border_wrap(cur_world);
+    world_timestep(cur_world, next_world);
+    cur_world = next_world;
+
+    *cycle = world_check_cycles(cur_world, iter);
+
+    return 1;
+}
+
+static int
+int_engine_count(void)
+{
+    return world_count(cur_world);
+}
+
+static void
+int_engine_emit(world_row_fn emit)
+{
+    world_emit(cur_world, emit);
+}
+
+/* bits engine: 64 cells per word */
+
+static void
+bit_engine_init(void)
+{
+    int h;
+
+    bit_word_keys = malloc(((world_cols + 63) / 64 + 1) * sizeof(uint64_t));
+    if (bit_word_keys == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (h = 0; h <= (world_cols + 63) / 64; h++)
+    {
+        bit_word_keys[h] = cycle_mix(h) | 1;
+    }
+
+    for (h = 0; h < HISTORY; h++)
+    {
+        bit_worlds[h].rows = world_rows;
+        bit_worlds[h].cols = world_cols;
+        bit_worlds[h].nwords = (world_cols + 63) / 64;
+        bit_worlds[h].words = alloc_2d_word_array(world_rows + 2, bit_worlds[h].nwords + 2);
+    }
+
+    cur_bit_world = &bit_worlds[0];
+    if (start_pattern.data != NULL)
+    {
+        bit_world_init_pattern(cur_bit_world);
+    }
+    else if (random_world)
+    {
+        bit_world_init_random(cur_bit_world);
+    }
+    else
+    {
+        bit_world_init_fixed(cur_bit_world);
+    }
+    cur_bit_world->fingerprint = bit_world_fingerprint(cur_bit_world);
+    cycle_detector_record(&cycles, 0, cur_bit_world->fingerprint);
+}
+
+static int
+bit_engine_advance(int iter, int ngens, int *cycle)
+{
+    bit_world *next_world = &bit_worlds[iter % HISTORY];
+
+    bit_world_border_wrap(cur_bit_world);
+    bit_world_timestep(cur_bit_world, next_world);
+    cur_bit_world = next_world;
+
+    *cycle = bit_world_check_cycles(cur_bit_world, iter);
+
+    return 1;
+}
+
+static int
+bit_engine_count(void)
+{
+    return bit_world_count(cur_bit_world);
+}
+
+static void
+bit_engine_emit(world_row_fn emit)
+{
+    bit_world_emit(cur_bit_world, emit);
+}
+
+/* blocked engine: temporal blocking, every cache-sized tile is advanced by
+ * block_depth generations before moving on to the next one. A tile is copied
+ * with a block_depth-deep halo, after each generation the valid region shrinks
+ * by one cell on each side, so the tile interior is exact after block_depth
+ * generations. The last two generations of a sweep are written back, which is
+ * all the cycle check of the next sweep needs. Periods 1 and 2 are checked
+ * tile by tile; for longer ones the tiles add up the fingerprint of every
+ * generation, and a sweep stops at a generation that the fingerprint ring
+ * wants to take a snapshot of or compare with one.
+ */
+
+static int block_depth = 8;   // generations per sweep
+static int tile_rows, tile_cols;
+static int **tile_bufs[HISTORY]; // generations g, g-1 and g-2 of the current tile
+static world *prev_world;     // the generation before cur_world
+static world *spare_world;
+
+// copy the tile plus halo starting at global row/col r0/c0 (0-based, may be
+// outside the world, it is wrapped around) into the local buffer
+static void
+tile_load(int **buf, world *src, int r0, int c0, int nrows, int ncols)
+{
+    int lr;
+
+    for (lr = 0; lr < nrows; lr++)
+    {
+        int row = ((r0 + lr) % world_rows + world_rows) % world_rows + 1;
+        int lc = 0;
+
+        // the wrapped columns are copied in contiguous runs
+        while (lc < ncols)
+        {
+            int col = ((c0 + lc) % world_cols + world_cols) % world_cols;
+            int run = world_cols - col;
+
+            if (run > ncols - lc)
+            {
+                run = ncols - lc;
+            }
+            memcpy(&buf[lr][lc], &src->cells[row][col + 1], run * sizeof(int));
+            lc += run;
+        }
+    }
+}
+
+static int
+tile_equal(int **a, int ar, int ac, int **b, int br, int bc, int nrows, int ncols)
+{
+    int row;
+
+    for (row = 0; row < nrows; row++)
+    {
+        if (memcmp(&a[ar + row][ac], &b[br + row][bc], ncols * sizeof(int)) != 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// advance the tile with interior at r0/c0 (0-based) of th x tw cells by ngens generations,
+// eq1[g] and eq2[g] are cleared when generation g of the tile differs from g - 1 or g - 2
+// and the fingerprint of generation g of the tile is added to fingerprints[g];
+// they are NULL when no cycle check is needed
+static void
+tile_advance(int r0, int c0, int th, int tw, int ngens,
+             world *out_prev, world *out_last, int *eq1, int *eq2, uint64_t *fingerprints)
+{
+    int nrows = th + 2 * ngens;
+    int ncols = tw + 2 * ngens;
+    int g, row;
+
+    tile_load(tile_bufs[0], cur_world, r0 - ngens, c0 - ngens, nrows, ncols);
+
+    for (g = 1; g <= ngens; g++)
+    {
+        int **old = tile_bufs[(g - 1) % HISTORY];
+        int **new = tile_bufs[g % HISTORY];
+
+        // only the region that is still exact after g generations is updated
+        for (row = g; row < nrows - g; row++)
+        {
+            row_step(&old[row - 1][g], &old[row][g], &old[row + 1][g], &new[row][g], ncols - 2 * g);
+        }
+
+        if (fingerprints != NULL)
+        {
+            for (row = 0; row < th; row++)
+            {
+                fingerprints[g] += cycle_row_fingerprint(r0 + 1 + row, c0 + 1, &new[ngens + row][ngens], tw);
+            }
+        }
+        if (eq1 != NULL && eq1[g] && !tile_equal(new, ngens, ngens, old, ngens, ngens, th, tw))
+        {
+            eq1[g] = 0;
+        }
+        if (eq2 != NULL && eq2[g])
+        {
+            if (g >= 2)
+            {
+                eq2[g] = tile_equal(new, ngens, ngens, tile_bufs[(g - 2) % HISTORY], ngens, ngens, th, tw);
+            }
+            else
+            {
+                eq2[g] = tile_equal(new, ngens, ngens, prev_world->cells, r0 + 1, c0 + 1, th, tw);
+            }
+        }
+    }
+
+    for (row = 0; row < th; row++)
+    {
+        if (ngens >= 2)
+        {
+            memcpy(&out_prev->cells[r0 + 1 + row][c0 + 1], &tile_bufs[(ngens - 1) % HISTORY][ngens + row][ngens],
+                   tw * sizeof(int));
+        }
+        memcpy(&out_last->cells[r0 + 1 + row][c0 + 1], &tile_bufs[ngens % HISTORY][ngens + row][ngens],
+               tw * sizeof(int));
+    }
+}
+
+static void
+blocked_sweep(int ngens, int *eq1, int *eq2, uint64_t *fingerprints)
+{
+    int r0, c0;
+
+    for (r0 = 0; r0 < world_rows; r0 += tile_rows)
+    {
+        for (c0 = 0; c0 < world_cols; c0 += tile_cols)
+        {
+            int th = world_rows - r0 < tile_rows ? world_rows - r0 : tile_rows;
+            int tw = world_cols - c0 < tile_cols ? world_cols - c0 : tile_cols;
+
+            tile_advance(r0, c0, th, tw, ngens, prev_world, spare_world, eq1, eq2, fingerprints);
+        }
+    }
+}
+
+static void
+blocked_engine_init(void)
+{
+    long cache_size;
+    int side, h;
+
+    int_engine_init();
+    prev_world = &worlds[1];
+    spare_world = &worlds[2];
+
+    // three tile buffers, halos included, should fit in L2
+    cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (cache_size <= 0)
+    {
+        cache_size = 1 << 20;
+    }
+    side = (int)sqrt(cache_size / (HISTORY * sizeof(int))) - 2 * block_depth;
+    if (side < 2 * block_depth)
+    {
+        side = 2 * block_depth;
+    }
+    if (side < 16)
+    {
+        side = 16;
+    }
+    tile_rows = side < world_rows ? side : world_rows;
+    tile_cols = side < world_cols ? side : world_cols;
+
+    for (h = 0; h < HISTORY; h++)
+    {
+        tile_bufs[h] = alloc_2d_int_array(tile_rows + 2 * block_depth, tile_cols + 2 * block_depth);
+    }
+}
+
+static int
+blocked_engine_advance(int iter, int ngens, int *cycle)
+{
+    int eq1[block_depth + 1], eq2[block_depth + 1];
+    uint64_t fingerprints[block_depth + 1];
+    int period = 0, due = 0, snapshot = 0;
+    world *src;
+    int g;
+
+    if (ngens > block_depth)
+    {
+        ngens = block_depth;
+    }
+
+    for (g = 1; g <= ngens; g++)
+    {
+        eq1[g] = 1;
+        eq2[g] = iter + g - 3 >= 0;
+        fingerprints[g] = 0;
+    }
+
+    blocked_sweep(ngens, eq1, eq2, fingerprints);
+
+    // stop at the first generation that repeats one of the two before it, or
+    // that the fingerprint ring needs as a whole world; the sweep is redone up
+    // to there since later generations were computed too
+    for (g = 1; g <= ngens; g++)
+    {
+        if (eq1[g] || eq2[g])
+        {
+            period = cycle_found(iter + g - 1, iter + g - 1 - (eq1[g] ? 1 : 2));
+        }
+        else if (cycle_detector_due(&cycles, iter + g - 1))
+        {
+            due = 1;
+        }
+        else
+        {
+            snapshot = cycle_detector_candidate(&cycles, iter + g - 1, fingerprints[g], HISTORY);
+        }
+        if (period || due || snapshot)
+        {
+            if (g < ngens)
+            {
+                ngens = g;
+                blocked_sweep(ngens, NULL, NULL, NULL);
+            }
+            break;
+        }
+    }
+
+    // the sweep wrote generation iter + ngens - 1 into spare_world, and the one
+    // before into prev_world unless that is cur_world itself
+    src = cur_world;
+    cur_world = spare_world;
+    if (ngens >= 2)
+    {
+        spare_world = src;
+    }
+    else
+    {
+        spare_world = prev_world;
+        prev_world = src;
+    }
+    cur_world->fingerprint = fingerprints[ngens];
+
+    if (due)
+    {
+        period = world_check_long_cycles(cur_world, iter + ngens - 1, HISTORY);
+    }
+    else if (snapshot)
+    {
+        world_take_snapshot(cur_world);
+    }
+    if (period)
+    {
+        *cycle = period;
+    }
+
+    return ngens;
+}
+
+/* active engine: the world is cut into small tiles with a changed flag each.
+ * A tile is only recomputed when it or one of its eight neighbours changed in
+ * the previous generation; the two worlds are used in turns, so a tile that is
+ * skipped still holds the cells of two generations ago, which are its current
+ * cells as well. The changed flags give periods 1 and 2; for longer ones every
+ * tile keeps its fingerprint, so the fingerprint of the world is updated with
+ * the recomputed tiles only.
+ */
+
+#define ACTIVE_TILE_ROWS 16
+#define ACTIVE_TILE_COLS 64
+
+static int active_tiles_r, active_tiles_c;
+static unsigned char *tile_active;
+static unsigned char *tile_changed;  // tile differs from the generation before
+static unsigned char *tile_changed2; // tile differs from two generations before
+static uint64_t *tile_fingerprints;
+static int *tile_row;
+static long active_tiles_sum;
+static int active_tiles_max, active_steps;
+
+static void
+active_engine_init(void)
+{
+    int ntiles, row, tc;
+
+    int_engine_init();
+
+    active_tiles_r = (world_rows + ACTIVE_TILE_ROWS - 1) / ACTIVE_TILE_ROWS;
+    active_tiles_c = (world_cols + ACTIVE_TILE_COLS - 1) / ACTIVE_TILE_COLS;
+    ntiles = active_tiles_r * active_tiles_c;
+
+    tile_active = malloc(ntiles);
+    tile_changed = malloc(ntiles);
+    tile_changed2 = malloc(ntiles);
+    tile_row = malloc(ACTIVE_TILE_COLS * sizeof(int));
+    tile_fingerprints = calloc(ntiles, sizeof(uint64_t));
+    if (tile_active == NULL || tile_changed == NULL || tile_changed2 == NULL || tile_row == NULL ||
+        tile_fingerprints == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (row = 1; row <= world_rows; row++)
+    {
+        for (tc = 0; tc < active_tiles_c; tc++)
+        {
+            int c0 = tc * ACTIVE_TILE_COLS + 1;
+            int tw = c0 + ACTIVE_TILE_COLS <= world_cols ? ACTIVE_TILE_COLS : world_cols + 1 - c0;
+
+            tile_fingerprints[(row - 1) / ACTIVE_TILE_ROWS * active_tiles_c + tc] +=
+                cycle_row_fingerprint(row, c0, &cur_world->cells[row][c0], tw);
+        }
+    }
+
+    // everything counts as changed before the first generation
+    memset(tile_changed, 1, ntiles);
+}
+
+// recompute one tile into next_world and its fingerprint, returns bit 0 set if
+// it changed since the previous generation and bit 1 if since the one before that
+static int
+active_tile_step(world *next_world, int tr, int tc)
+{
+    int **cells = cur_world->cells;
+    int r0 = tr * ACTIVE_TILE_ROWS + 1;
+    int c0 = tc * ACTIVE_TILE_COLS + 1;
+    int r1 = r0 + ACTIVE_TILE_ROWS <= world_rows ? r0 + ACTIVE_TILE_ROWS : world_rows + 1;
+    int tw = c0 + ACTIVE_TILE_COLS <= world_cols ? ACTIVE_TILE_COLS : world_cols + 1 - c0;
+    uint64_t fingerprint = 0;
+    int changed = 0;
+    int row;
+
+    for (row = r0; row < r1; row++)
+    {
+        int *out = &next_world->cells[row][c0];
+
+        row_step(&cells[row - 1][c0], &cells[row][c0], &cells[row + 1][c0], tile_row, tw);
+        fingerprint += cycle_row_fingerprint(row, c0, tile_row, tw);
+        if (!(changed & 1) && memcmp(tile_row, &cells[row][c0], tw * sizeof(int)) != 0)
+        {
+            changed |= 1;
+        }
+        if (!(changed & 2) && memcmp(tile_row, out, tw * sizeof(int)) != 0)
+        {
+            changed |= 2;
+        }
+        memcpy(out, tile_row, tw * sizeof(int));
+    }
+    tile_fingerprints[tr * active_tiles_c + tc] = fingerprint;
+
+    return changed;
+}
+
+static int
+active_engine_advance(int iter, int ngens, int *cycle)
+{
+    world *next_world = &worlds[iter % 2];
+    uint64_t fingerprint = cur_world->fingerprint;
+    int any_changed = 0, any_changed2 = 0, nactive = 0;
+    int tr, tc, dr, dc;
+
+    // a tile is active if any tile in its 3x3 neighbourhood changed
+    for (tr = 0; tr < active_tiles_r; tr++)
+    {
+        for (tc = 0; tc < active_tiles_c; tc++)
+        {
+            int active = 0;
+
+            for (dr = -1; dr <= 1 && !active; dr++)
+            {
+                for (dc = -1; dc <= 1 && !active; dc++)
+                {
+                    int r = (tr + dr + active_tiles_r) % active_tiles_r;
+                    int c = (tc + dc + active_tiles_c) % active_tiles_c;
+
+                    active = tile_changed[r * active_tiles_c + c];
+                }
+            }
+            tile_active[tr * active_tiles_c + tc] = active;
+        }
+    }
+
+    world_border_wrap(cur_world);
+    for (tr = 0; tr < active_tiles_r; tr++)
+    {
+        for (tc = 0; tc < active_tiles_c; tc++)
+        {
+            int t = tr * active_tiles_c + tc;
+            int changed = 0;
+
+            if (tile_active[t])
+            {
+                fingerprint -= tile_fingerprints[t];
+                changed = active_tile_step(next_world, tr, tc);
+                fingerprint += tile_fingerprints[t];
+                nactive++;
+            }
+            tile_changed[t] = changed & 1;
+            tile_changed2[t] = (changed & 2) >> 1;
+            any_changed |= changed & 1;
+            any_changed2 |= changed & 2;
+        }
+    }
+    cur_world = next_world;
+    cur_world->fingerprint = fingerprint;
+
+    active_tiles_sum += nactive;
+    active_steps++;
+    if (nactive > active_tiles_max)
+    {
+        active_tiles_max = nactive;
+    }
+    if (print_cells > 0 && (iter % print_cells) == (print_cells - 1))
+    {
+        fprintf(stderr, "%d: %d of %d tiles active\n", iter, nactive, active_tiles_r * active_tiles_c);
+    }
+
+    // no tile changed means the whole world did not
+    if (!any_changed)
+    {
+        *cycle = cycle_found(iter, iter - 1);
+    }
+    else if (iter >= 2 && !any_changed2)
+    {
+        *cycle = cycle_found(iter, iter - 2);
+    }
+    else
+    {
+        *cycle = world_check_long_cycles(cur_world, iter, HISTORY);
+    }
+
+    return 1;
+}
+
+static void
+active_engine_report(void)
+{
+    if (active_steps > 0)
+    {
+        fprintf(stderr, "active tiles per step: %.1f on average, %d at most, of %d\n",
+                (double)active_tiles_sum / active_steps, active_tiles_max, active_tiles_r * active_tiles_c);
+    }
+}
+
+/* hashlife engine: the world is a quadtree of canonical nodes, identical
+ * subtrees are stored once, and every node memoises its centre a power of two
+ * generations ahead. Repetitive patterns then advance by 2^k generations in
+ * one go. The torus is simulated as the infinite plane tiled with copies of
+ * the world; when rows and cols are powers of two the tiling itself is made of
+ * shared nodes and the world never has to be unpacked between jumps.
+ *
+ * The engine does not detect cycles. A jump skips the generations in between,
+ * so the first repeated generation is never seen; a cyclic world runs all of
+ * its steps, and -f has no effect.
+ */
+
+typedef struct hl_node
+{
+    struct hl_node *nw, *ne, *sw, *se; // quadrants, NULL for single cells
+    struct hl_node *result;            // centre after 2^result_step generations
+    struct hl_node *next;              // hash chain, or free list
+    int64_t population;
+    int level; // the node is 2^level cells on a side, -1 when free
+    int result_step;
+    int mark;
+} hl_node;
+
+#define HL_BLOCK_NODES 4096
+
+// what the garbage collector does with memoised results
+#define HL_GC_OFF 0  // no collection, exceeding the cap is an error
+#define HL_GC_DROP 1 // forget all memoised results
+#define HL_GC_KEEP 2 // keep results of live nodes, drop them only if that is not enough
+
+static size_t hl_memory_cap = (size_t)1024 << 20;
+static int hl_gc_policy = HL_GC_KEEP;
+
+static hl_node hl_leaves[2] = {{NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, -1, 0},
+                               {NULL, NULL, NULL, NULL, NULL, NULL, 1, 0, -1, 0}};
+static hl_node *hl_empties[64];
+static hl_node **hl_buckets;
+static size_t hl_nbuckets, hl_nnodes;
+static hl_node **hl_blocks;
+static size_t hl_nblocks;
+static hl_node *hl_free;
+static int hl_ngcs;
+
+static hl_node *hl_root;       // the world, only used when rows and cols are powers of two
+static int hl_root_level;      // level of a square that holds a whole number of worlds
+static unsigned char *hl_cells; // the world as rows x cols cells, when it is unpacked
+static int hl_cells_valid;
+
+static size_t
+hl_memory(void)
+{
+    return hl_nnodes * sizeof(hl_node) + hl_nbuckets * sizeof(hl_node *);
+}
+
+static size_t
+hl_hash(hl_node *nw, hl_node *ne, hl_node *sw, hl_node *se)
+{
+    uint64_t h;
+
+    h = (uint64_t)(uintptr_t)nw * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (uint64_t)(uintptr_t)ne) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (uint64_t)(uintptr_t)sw) * 0x94d049bb133111ebULL;
+    h = (h ^ (uint64_t)(uintptr_t)se) * 0x9e3779b97f4a7c15ULL;
+
+    return (size_t)(h ^ (h >> 29));
+}
+
+static void
+hl_rehash(size_t nbuckets)
+{
+    hl_node **buckets;
+    size_t b;
+
+    buckets = calloc(nbuckets, sizeof(hl_node *));
+    if (buckets == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (b = 0; b < hl_nbuckets; b++)
+    {
+        hl_node *n = hl_buckets[b];
+
+        while (n != NULL)
+        {
+            hl_node *next = n->next;
+            size_t h = hl_hash(n->nw, n->ne, n->sw, n->se) & (nbuckets - 1);
+
+            n->next = buckets[h];
+            buckets[h] = n;
+            n = next;
+        }
+    }
+
+    free(hl_buckets);
+    hl_buckets = buckets;
+    hl_nbuckets = nbuckets;
+}
+
+static hl_node *
+hl_alloc(void)
+{
+    hl_node *n;
+
+    if (hl_free == NULL)
+    {
+        hl_node *block;
+        int i;
+
+        block = malloc(HL_BLOCK_NODES * sizeof(hl_node));
+        hl_blocks = realloc(hl_blocks, (hl_nblocks + 1) * sizeof(hl_node *));
+        if (block == NULL || hl_blocks == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        hl_blocks[hl_nblocks++] = block;
+
+        for (i = HL_BLOCK_NODES - 1; i >= 0; i--)
+        {
+            block[i].level = -1;
+            block[i].next = hl_free;
+            hl_free = &block[i];
+        }
+    }
+
+    n = hl_free;
+    hl_free = n->next;
+    hl_nnodes++;
+
+    return n;
+}
+
+// the canonical node with these quadrants
+static hl_node *
+hl_find(hl_node *nw, hl_node *ne, hl_node *sw, hl_node *se)
+{
+    size_t h = hl_hash(nw, ne, sw, se) & (hl_nbuckets - 1);
+    hl_node *n;
+
+    for (n = hl_buckets[h]; n != NULL; n = n->next)
+    {
+        if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)
+        {
+            return n;
+        }
+    }
+
+    n = hl_alloc();
+    n->nw = nw;
+    n->ne = ne;
+    n->sw = sw;
+    n->se = se;
+    n->result = NULL;
+    n->result_step = -1;
+    n->population = nw->population + ne->population + sw->population + se->population;
+    n->level = nw->level + 1;
+    n->mark = 0;
+    n->next = hl_buckets[h];
+    hl_buckets[h] = n;
+
+    if (hl_nnodes > hl_nbuckets)
+    {
+        hl_rehash(2 * hl_nbuckets);
+    }
+
+    return n;
+}
+
+static hl_node *
+hl_empty(int level)
+{
+    if (hl_empties[level] == NULL)
+    {
+        hl_node *e = level == 0 ? &hl_leaves[0] : hl_empty(level - 1);
+
+        hl_empties[level] = level == 0 ? e : hl_find(e, e, e, e);
+    }
+
+    return hl_empties[level];
+}
+
+static void
+hl_mark(hl_node *n, int results)
+{
+    if (n == NULL || n->level <= 0 || n->mark)
+    {
+        return;
+    }
+
+    n->mark = 1;
+    hl_mark(n->nw, results);
+    hl_mark(n->ne, results);
+    hl_mark(n->sw, results);
+    hl_mark(n->se, results);
+    if (results)
+    {
+        hl_mark(n->result, results);
+    }
+}
+
+// free every node that is not reachable from the world or the empty nodes
+static void
+hl_gc(int results)
+{
+    size_t b;
+    int i, level;
+
+    hl_mark(hl_root, results);
+    for (level = 0; level < 64; level++)
+    {
+        hl_mark(hl_empties[level], results);
+    }
+
+    memset(hl_buckets, 0, hl_nbuckets * sizeof(hl_node *));
+    hl_free = NULL;
+    hl_nnodes = 0;
+    for (b = 0; b < hl_nblocks; b++)
+    {
+        for (i = 0; i < HL_BLOCK_NODES; i++)
+        {
+            hl_node *n = &hl_blocks[b][i];
+
+            if (n->level > 0 && n->mark)
+            {
+                size_t h = hl_hash(n->nw, n->ne, n->sw, n->se) & (hl_nbuckets - 1);
+
+                n->mark = 0;
+                if (!results)
+                {
+                    n->result = NULL;
+                    n->result_step = -1;
+                }
+                n->next = hl_buckets[h];
+                hl_buckets[h] = n;
+                hl_nnodes++;
+            }
+            else
+            {
+                n->level = -1;
+                n->next = hl_free;
+                hl_free = n;
+            }
+        }
+    }
+    hl_ngcs++;
+}
+
+// called between jumps, when no node is referenced from the C stack
+static void
+hl_check_memory(void)
+{
+    if (hl_memory() <= hl_memory_cap)
+    {
+        return;
+    }
+
+    if (hl_gc_policy == HL_GC_OFF)
+    {
+        fprintf(stderr, "hashlife memory cap of %zu MB exceeded\n", hl_memory_cap >> 20);
+        exit(1);
+    }
+
+    hl_gc(hl_gc_policy == HL_GC_KEEP);
+    if (hl_gc_policy == HL_GC_KEEP && hl_memory() > hl_memory_cap / 2)
+    {
+        hl_gc(0);
+    }
+}
+
+static hl_node *
+hl_centre(hl_node *n)
+{
+    return hl_find(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+// 4x4 cells to the centre 2x2 after one generation
+static hl_node *
+hl_base(hl_node *n)
+{
+    hl_node *quads[2][2] = {{n->nw, n->ne}, {n->sw, n->se}};
+    int cells[4][4];
+    int next[2][2];
+    int row, col;
+
+    for (row = 0; row < 4; row++)
+    {
+        for (col = 0; col < 4; col++)
+        {
+            hl_node *q = quads[row / 2][col / 2];
+            hl_node *leaf = row % 2 ? (col % 2 ? q->se : q->sw) : (col % 2 ? q->ne : q->nw);
+
+            cells[row][col] = (int)leaf->population;
+        }
+    }
+
+    for (row = 1; row <= 2; row++)
+    {
+        for (col = 1; col <= 2; col++)
+        {
+            int nsum = cells[row - 1][col - 1] + cells[row - 1][col] + cells[row - 1][col + 1] +
+                       cells[row][col - 1] + cells[row][col + 1] +
+                       cells[row + 1][col - 1] + cells[row + 1][col] + cells[row + 1][col + 1];
+
+            next[row - 1][col - 1] = nsum == 3 || (nsum == 2 && cells[row][col]);
+        }
+    }
+
+    return hl_find(&hl_leaves[next[0][0]], &hl_leaves[next[0][1]],
+                   &hl_leaves[next[1][0]], &hl_leaves[next[1][1]]);
+}
+
+// the centre half of node n after 2^step generations, step <= n->level - 2
+static hl_node *
+hl_result(hl_node *n, int step)
+{
+    hl_node *sub[3][3], *res[3][3];
+    hl_node *result;
+    int full, inner, i, j;
+
+    if (n->result != NULL && n->result_step == step)
+    {
+        return n->result;
+    }
+
+    if (n->population == 0)
+    {
+        result = hl_empty(n->level - 1);
+    }
+    else if (n->level == 2)
+    {
+        result = hl_base(n);
+    }
+    else
+    {
+        // nine overlapping subnodes of half the size
+        sub[0][0] = n->nw;
+        sub[0][1] = hl_find(n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw);
+        sub[0][2] = n->ne;
+        sub[1][0] = hl_find(n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne);
+        sub[1][1] = hl_centre(n);
+        sub[1][2] = hl_find(n->ne->sw, n->ne->se, n->se->nw, n->se->ne);
+        sub[2][0] = n->sw;
+        sub[2][1] = hl_find(n->sw->ne, n->se->nw, n->sw->se, n->se->sw);
+        sub[2][2] = n->se;
+
+        // at full speed both rounds advance half of the generations,
+        // otherwise the first round only takes the centres
+        full = step == n->level - 2;
+        inner = full ? step - 1 : step;
+        for (i = 0; i < 3; i++)
+        {
+            for (j = 0; j < 3; j++)
+            {
+                res[i][j] = full ? hl_result(sub[i][j], inner) : hl_centre(sub[i][j]);
+            }
+        }
+
+        result = hl_find(hl_result(hl_find(res[0][0], res[0][1], res[1][0], res[1][1]), inner),
+                         hl_result(hl_find(res[0][1], res[0][2], res[1][1], res[1][2]), inner),
+                         hl_result(hl_find(res[1][0], res[1][1], res[2][0], res[2][1]), inner),
+                         hl_result(hl_find(res[1][1], res[1][2], res[2][1], res[2][2]), inner));
+    }
+
+    n->result = result;
+    n->result_step = step;
+
+    return result;
+}
+
+static int
+hl_torus_cell(int64_t row, int64_t col)
+{
+    row = (row % world_rows + world_rows) % world_rows;
+    col = (col % world_cols + world_cols) % world_cols;
+
+    return hl_cells[row * world_cols + col];
+}
+
+// the node for the square of the tiled plane with top left corner at r0/c0
+static hl_node *
+hl_build(int level, int64_t r0, int64_t c0)
+{
+    int64_t half;
+
+    if (level == 0)
+    {
+        return &hl_leaves[hl_torus_cell(r0, c0)];
+    }
+
+    half = (int64_t)1 << (level - 1);
+    return hl_find(hl_build(level - 1, r0, c0), hl_build(level - 1, r0, c0 + half),
+                   hl_build(level - 1, r0 + half, c0), hl_build(level - 1, r0 + half, c0 + half));
+}
+
+// unpack the part of node n, with top left corner at r0/c0, that lies in the world
+static void
+hl_extract(hl_node *n, int64_t r0, int64_t c0)
+{
+    int64_t side = (int64_t)1 << n->level;
+
+    if (n->population == 0 || r0 >= world_rows || c0 >= world_cols || r0 + side <= 0 || c0 + side <= 0)
+    {
+        return;
+    }
+
+    if (n->level == 0)
+    {
+        hl_cells[r0 * world_cols + c0] = 1;
+        return;
+    }
+
+    hl_extract(n->nw, r0, c0);
+    hl_extract(n->ne, r0, c0 + side / 2);
+    hl_extract(n->sw, r0 + side / 2, c0);
+    hl_extract(n->se, r0 + side / 2, c0 + side / 2);
+}
+
+static void
+hl_unpack(void)
+{
+    if (!hl_cells_valid)
+    {
+        memset(hl_cells, 0, (size_t)world_rows * world_cols);
+        hl_extract(hl_root, 0, 0);
+        hl_cells_valid = 1;
+    }
+}
+
+// a square of copies of the world is advanced as a whole; once the tiling is at
+// least twice as large as the world, the centre of the result is again aligned
+// to the copies and its top left corner is the world
+static void
+hl_jump_tiled(int step)
+{
+    int level = step > hl_root_level ? step + 2 : hl_root_level + 2;
+    hl_node *n = hl_root;
+
+    while (n->level < level)
+    {
+        n = hl_find(n, n, n, n);
+    }
+    n = hl_result(n, step);
+    while (n->level > hl_root_level)
+    {
+        n = n->nw;
+    }
+
+    hl_root = n;
+    hl_cells_valid = 0;
+}
+
+// other world sizes do not tile a quadtree, so the world is rebuilt from
+// cells with a margin of 2^(level - 2) copied around it for every jump
+static void
+hl_jump_window(int step)
+{
+    int64_t margin = (int64_t)1 << (hl_root_level - 2);
+    hl_node *n;
+
+    n = hl_result(hl_build(hl_root_level, -margin, -margin), step);
+    memset(hl_cells, 0, (size_t)world_rows * world_cols);
+    hl_extract(n, 0, 0);
+}
+
+static int
+is_power_of_two(int x)
+{
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+static void
+hashlife_engine_init(void)
+{
+    world start;
+    int row, col, side;
+
+    // reuse the int initialisation, then keep a byte per cell
+    hl_cells = malloc((size_t)world_rows * world_cols);
+    if (hl_cells == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    start.rows = world_rows;
+    start.cols = world_cols;
+    start.cells = alloc_2d_int_array(world_rows + 2, world_cols + 2);
+    if (start_pattern.data != NULL)
+    {
+        world_init_pattern(&start);
+    }
+    else if (random_world)
+    {
+        world_init_random(&start);
+    }
+    else
+    {
+        world_init_fixed(&start);
+    }
+
+    for (row = 1; row <= world_rows; row++)
+    {
+        for (col = 1; col <= world_cols; col++)
+        {
+            hl_cells[(size_t)(row - 1) * world_cols + col - 1] = start.cells[row][col];
+        }
+    }
+    free(start.cells[0]);
+    free(start.cells);
+    hl_cells_valid = 1;
+
+    hl_rehash(1 << 16);
+
+    side = world_rows > world_cols ? world_rows : world_cols;
+    if (is_power_of_two(world_rows) && is_power_of_two(world_cols))
+    {
+        for (hl_root_level = 0; (1 << hl_root_level) < side; hl_root_level++)
+            ;
+        hl_root = hl_build(hl_root_level, 0, 0);
+    }
+    else
+    {
+        // the centre half of the node has to hold the world
+        for (hl_root_level = 2; (1 << (hl_root_level - 1)) < side; hl_root_level++)
+            ;
+        hl_root = NULL;
+    }
+}
+
+// *cycle is left alone, see above
+static int
+hashlife_engine_advance(int iter, int ngens, int *cycle)
+{
+    int done = 0;
+
+    while (done < ngens)
+    {
+        int step = 0;
+
+        // the largest power of two that is left, and that fits in the margin
+        while ((2 << step) <= ngens - done && step < 30 && (hl_root != NULL || step + 1 <= hl_root_level - 2))
+        {
+            step++;
+        }
+
+        hl_check_memory();
+        if (hl_root != NULL)
+        {
+            hl_jump_tiled(step);
+        }
+        else
+        {
+            hl_jump_window(step);
+        }
+        done += 1 << step;
+    }
+
+    return ngens;
+}
+
+static int
+hashlife_engine_count(void)
+{
+    int64_t side = (int64_t)1 << hl_root_level;
+    int64_t isum = 0;
+    size_t i;
+
+    // the root square holds side * side / (rows * cols) copies of the world
+    if (hl_root != NULL)
+    {
+        return (int)(hl_root->population / (side * side / ((int64_t)world_rows * world_cols)));
+    }
+
+    for (i = 0; i < (size_t)world_rows * world_cols; i++)
+    {
+        isum += hl_cells[i];
+    }
+
+    return (int)isum;
+}
+
+static void
+hashlife_engine_emit(world_row_fn emit)
+{
+    int row, col;
+
+    hl_unpack();
+    for (row = 0; row < world_rows; row++)
+    {
+        for (col = 0; col < world_cols; col++)
+        {
+            row_cells[col] = hl_cells[(size_t)row * world_cols + col];
+        }
+        emit(row_cells);
+    }
+}
+
+static void
+hashlife_engine_report(void)
+{
+    fprintf(stderr, "hashlife: %zu nodes, %zu MB, %d garbage collections, no cycle detection\n",
+            hl_nnodes, hl_memory() >> 20, hl_ngcs);
+}
+
+/* sparse engine: only the live cells are kept, as a sorted list of cell
+ * indices (row - 1) * cols + col - 1. A generation counts the neighbours of
+ * every live cell in an open addressing hash table, so its cost follows the
+ * population rather than the world size. Once the density reaches
+ * sparse_threshold the engine hands over to the int engine for good.
+ */
+
+typedef struct
+{
+    size_t n, cap;
+    uint64_t *cells;
+    uint64_t fingerprint;
+} sparse_world;
+
+#define SPARSE_EMPTY UINT64_MAX
+#define SPARSE_ALIVE 16 // flag next to the neighbour count in a hash slot
+
+static sparse_world sparse_worlds[HISTORY];
+static sparse_world *cur_sparse_world;
+static sparse_world sparse_cycle_snapshot;
+static double sparse_threshold = 0.01;
+static int sparse_dense = 0;        // handed over to the int engine
+static int sparse_handover = -1;    // generation of the hand over
+static uint64_t *sparse_keys;
+static unsigned char *sparse_counts;
+static size_t sparse_nslots;
+
+static void
+sparse_world_add(sparse_world *world, uint64_t idx)
+{
+    if (world->n == world->cap)
+    {
+        world->cap = world->cap ? 2 * world->cap : 1024;
+        world->cells = realloc(world->cells, world->cap * sizeof(uint64_t));
+        if (world->cells == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    world->cells[world->n++] = idx;
+}
+
+static void
+sparse_world_init_fixed(sparse_world *world)
+{
+    int row, col;
+
+    /* use predefined start_world, same as world_init_fixed */
+
+    world->n = 0;
+    for (row = 1; row <= world_rows && row <= sizeof(start_world) / sizeof(char *); row++)
+    {
+        for (col = 1; col <= world_cols && col <= strlen(start_world[row - 1]); col++)
+        {
+            if (start_world[row - 1][col - 1] != '.')
+            {
+                sparse_world_add(world, (uint64_t)(row - 1) * world_cols + col - 1);
+            }
+        }
+    }
+}
+
+static int
+compare_cells(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void
+sparse_world_set_cell(void *ctx, int row, int col)
+{
+    sparse_world_add((sparse_world *)ctx, (uint64_t)(row - 1) * world_cols + col - 1);
+}
+
+static void
+sparse_world_init_pattern(sparse_world *world)
+{
+    size_t i, n = 0;
+
+    world->n = 0;
+    pattern_fill(&start_pattern, 1, world_rows, 1, world_cols, sparse_world_set_cell, world);
+
+    // Life 1.06 lists the cells in any order, possibly more than once
+    qsort(world->cells, world->n, sizeof(uint64_t), compare_cells);
+    for (i = 0; i < world->n; i++)
+    {
+        if (n == 0 || world->cells[i] != world->cells[n - 1])
+        {
+            world->cells[n++] = world->cells[i];
+        }
+    }
+    world->n = n;
+}
+
+static void
+sparse_world_init_random(sparse_world *world)
+{
+    uint64_t first, last;
+
+    // the same cells as world_init_random, a word of them at a time
+    world->n = 0;
+    for (first = 0; first < (uint64_t)world_rows * world_cols; first = last)
+    {
+        uint64_t row_end = (first / world_cols + 1) * world_cols;
+        uint64_t word;
+
+        last = first + 64 < row_end ? first + 64 : row_end;
+        for (word = rng_word(first, last - first); word != 0; word &= word - 1)
+        {
+            sparse_world_add(world, first + __builtin_ctzll(word));
+        }
+    }
+}
+
+static void
+sparse_world_emit(sparse_world *world, world_row_fn emit)
+{
+    size_t i = 0;
+    int row;
+
+    for (row = 1; row <= world_rows; row++)
+    {
+        memset(row_cells, 0, world_cols * sizeof(int));
+        for (; i < world->n && world->cells[i] < (uint64_t)row * world_cols; i++)
+        {
+            row_cells[world->cells[i] - (uint64_t)(row - 1) * world_cols] = 1;
+        }
+        emit(row_cells);
+    }
+}
+
+static uint64_t
+sparse_world_fingerprint(sparse_world *world)
+{
+    uint64_t fingerprint = 0;
+    size_t i;
+
+    for (i = 0; i < world->n; i++)
+    {
+        fingerprint += cycle_row_keys[world->cells[i] / world_cols + 1] * (uint64_t)cycle_col_keys[world->cells[i] % world_cols + 1];
+    }
+
+    return fingerprint;
+}
+
+static unsigned char *
+sparse_slot(uint64_t idx)
+{
+    uint64_t h = idx * 0x9e3779b97f4a7c15ULL;
+    size_t slot = (size_t)(h ^ (h >> 32)) & (sparse_nslots - 1);
+
+    while (sparse_keys[slot] != idx && sparse_keys[slot] != SPARSE_EMPTY)
+    {
+        slot = (slot + 1) & (sparse_nslots - 1);
+    }
+    if (sparse_keys[slot] == SPARSE_EMPTY)
+    {
+        sparse_keys[slot] = idx;
+        sparse_counts[slot] = 0;
+    }
+
+    return &sparse_counts[slot];
+}
+
+static void
+sparse_world_timestep(sparse_world *old, sparse_world *new)
+{
+    size_t nslots = 1024;
+    size_t i;
+
+    // every live cell touches at most nine slots, keep the table at most half full
+    while (nslots < 18 * old->n)
+    {
+        nslots *= 2;
+    }
+    if (nslots > sparse_nslots)
+    {
+        free(sparse_keys);
+        free(sparse_counts);
+        sparse_keys = malloc(nslots * sizeof(uint64_t));
+        sparse_counts = malloc(nslots);
+        if (sparse_keys == NULL || sparse_counts == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        sparse_nslots = nslots;
+    }
+    memset(sparse_keys, 0xff, sparse_nslots * sizeof(uint64_t));
+
+    for (i = 0; i < old->n; i++)
+    {
+        uint64_t row = old->cells[i] / world_cols;
+        uint64_t col = old->cells[i] % world_cols;
+        uint64_t row_m = row == 0 ? world_rows - 1 : row - 1;
+        uint64_t row_p = row == world_rows - 1 ? 0 : row + 1;
+        uint64_t col_m = col == 0 ? world_cols - 1 : col - 1;
+        uint64_t col_p = col == world_cols - 1 ? 0 : col + 1;
+
+        *sparse_slot(old->cells[i]) |= SPARSE_ALIVE;
+        (*sparse_slot(row_m * world_cols + col_m))++;
+        (*sparse_slot(row_m * world_cols + col))++;
+        (*sparse_slot(row_m * world_cols + col_p))++;
+        (*sparse_slot(row * world_cols + col_m))++;
+        (*sparse_slot(row * world_cols + col_p))++;
+        (*sparse_slot(row_p * world_cols + col_m))++;
+        (*sparse_slot(row_p * world_cols + col))++;
+        (*sparse_slot(row_p * world_cols + col_p))++;
+    }
+
+    new->n = 0;
+    for (i = 0; i < sparse_nslots; i++)
+    {
+        int nsum = sparse_counts[i] & (SPARSE_ALIVE - 1);
+
+        if (sparse_keys[i] != SPARSE_EMPTY && (nsum == 3 || (nsum == 2 && (sparse_counts[i] & SPARSE_ALIVE))))
+        {
+            sparse_world_add(new, sparse_keys[i]);
+        }
+    }
+    qsort(new->cells, new->n, sizeof(uint64_t), compare_cells);
+    new->fingerprint = sparse_world_fingerprint(new);
+}
+
+static int
+sparse_world_equal(sparse_world *a, sparse_world *b)
+{
+    return a->n == b->n && memcmp(a->cells, b->cells, a->n * sizeof(uint64_t)) == 0;
+}
+
+static int
+sparse_world_check_cycles(sparse_world *cur_world, int iter)
+{
+    int i;
+    size_t j;
+
+    /* same approach as world_check_cycles */
+    for (i = iter - 1; i >= 0 && i > iter - HISTORY; i--)
+    {
+        sparse_world *prev_world = &sparse_worlds[i % HISTORY];
+
+        if (prev_world->fingerprint == cur_world->fingerprint && sparse_world_equal(cur_world, prev_world))
+        {
+            return cycle_found(iter, i);
+        }
+    }
+
+    if (cycle_detector_due(&cycles, iter))
+    {
+        cycles.pending_period = 0;
+        if (sparse_world_equal(cur_world, &sparse_cycle_snapshot))
+        {
+            return cycle_found(iter, cycles.pending_iter);
+        }
+    }
+
+    if (cycle_detector_candidate(&cycles, iter, cur_world->fingerprint, HISTORY))
+    {
+        sparse_cycle_snapshot.n = 0;
+        for (j = 0; j < cur_world->n; j++)
+        {
+            sparse_world_add(&sparse_cycle_snapshot, cur_world->cells[j]);
+        }
+    }
+
+    return 0;
+}
+
+// continue with the int engine from generation iter, with the history it needs
+static void
+sparse_hand_over(int iter)
+{
+    int i, h;
+    size_t j;
+
+    int_engine_alloc();
+    for (i = iter - HISTORY + 1 > 0 ? iter - HISTORY + 1 : 0; i <= iter; i++)
+    {
+        world *world = &worlds[i % HISTORY];
+        sparse_world *sparse = &sparse_worlds[i % HISTORY];
+
+        memset(&world->cells[0][0], 0, (size_t)(world_rows + 2) * (world_cols + 2) * sizeof(int));
+        for (j = 0; j < sparse->n; j++)
+        {
+            world->cells[sparse->cells[j] / world_cols + 1][sparse->cells[j] % world_cols + 1] = 1;
+        }
+        world->fingerprint = sparse->fingerprint;
+    }
+    cur_world = &worlds[iter % HISTORY];
+
+    // the fingerprints carry over, a pending snapshot does not
+    cycles.pending_period = 0;
+    free(sparse_cycle_snapshot.cells);
+
+    for (h = 0; h < HISTORY; h++)
+    {
+        free(sparse_worlds[h].cells);
+    }
+    free(sparse_keys);
+    free(sparse_counts);
+    sparse_dense = 1;
+    sparse_handover = iter;
+}
+
+static int
+sparse_too_dense(void)
+{
+    return cur_sparse_world->n >= sparse_threshold * world_rows * world_cols;
+}
+
+static void
+sparse_engine_init(void)
+{
+    cur_sparse_world = &sparse_worlds[0];
+    if (start_pattern.data != NULL)
+    {
+        sparse_world_init_pattern(cur_sparse_world);
+    }
+    else if (random_world)
+    {
+        sparse_world_init_random(cur_sparse_world);
+    }
+    else
+    {
+        sparse_world_init_fixed(cur_sparse_world);
+    }
+    cur_sparse_world->fingerprint = sparse_world_fingerprint(cur_sparse_world);
+    cycle_detector_record(&cycles, 0, cur_sparse_world->fingerprint);
+
+    if (sparse_too_dense())
+    {
+        sparse_hand_over(0);
+    }
+}
+
+// the default: a random world is known to be dense without generating it
+static void
+auto_engine_init(void)
+{
+    if (start_pattern.data == NULL && random_world && rng_density >= sparse_threshold)
+    {
+        int_engine_init();
+        sparse_dense = 1;
+        sparse_handover = 0;
+    }
+    else
+    {
+        sparse_engine_init();
+    }
+}
+
+static int
+sparse_engine_advance(int iter, int ngens, int *cycle)
+{
+    sparse_world *next_world;
+
+    if (sparse_dense)
+    {
+        return int_engine_advance(iter, ngens, cycle);
+    }
+
+    next_world = &sparse_worlds[iter % HISTORY];
+    sparse_world_timestep(cur_sparse_world, next_world);
+    cur_sparse_world = next_world;
+
+    *cycle = sparse_world_check_cycles(cur_sparse_world, iter);
+
+    if (!*cycle && sparse_too_dense())
+    {
+        sparse_hand_over(iter);
+    }
+
+    return 1;
+}
+
+static int
+sparse_engine_count(void)
+{
+    return sparse_dense ? int_engine_count() : (int)cur_sparse_world->n;
+}
+
+static void
+sparse_engine_emit(world_row_fn emit)
+{
+    if (sparse_dense)
+    {
+        int_engine_emit(emit);
+    }
+    else
+    {
+        sparse_world_emit(cur_sparse_world, emit);
+    }
+}
+
+static void
+sparse_engine_report(void)
+{
+    if (sparse_handover == 0)
+    {
+        fprintf(stderr, "dense from the start\n");
+    }
+    else if (sparse_handover > 0)
+    {
+        fprintf(stderr, "sparse until generation %d, dense after\n", sparse_handover);
+    }
+    else
+    {
+        fprintf(stderr, "sparse throughout\n");
+    }
+}
+
+static engine engines[] = {
+    {"auto", auto_engine_init, sparse_engine_advance, sparse_engine_count, sparse_engine_emit, sparse_engine_report},
+    {"int", int_engine_init, int_engine_advance, int_engine_count, int_engine_emit, NULL},
+    {"bits", bit_engine_init, bit_engine_advance, bit_engine_count, bit_engine_emit, NULL},
+    {"blocked", blocked_engine_init, blocked_engine_advance, int_engine_count, int_engine_emit, NULL},
+    {"active", active_engine_init, active_engine_advance, int_engine_count, int_engine_emit, active_engine_report},
+    {"hashlife", hashlife_engine_init, hashlife_engine_advance, hashlife_engine_count, hashlife_engine_emit, hashlife_engine_report},
+    {"sparse", sparse_engine_init, sparse_engine_advance, sparse_engine_count, sparse_engine_emit, sparse_engine_report},
+};
+
+static engine *
+find_engine(const char *name)
+{
+    int e;
+
+    for (e = 0; e < sizeof(engines) / sizeof(engine); e++)
+    {
+        if (strcmp(engines[e].name, name) == 0)
+        {
+            return &engines[e];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+engine_print(engine *eng)
+{
+    render_begin(world_rows, world_cols);
+    eng->emit(render_row);
+    render_end();
+}
+
+// add the cells of a row that flipped, or that are alive in a keyframe
+static void
+stream_row(const int *cells)
+{
+    uint64_t *words = &stream_world[(size_t)stream_row_index * stream_words];
+    uint64_t index = (uint64_t)stream_row_index * world_cols;
+    int key = stream.record.kind == STREAM_KEY;
+    int w, j;
+
+    for (w = 0; w < stream_words; w++)
+    {
+        int n = world_cols - 64 * w < 64 ? world_cols - 64 * w : 64;
+        uint64_t word = 0, flips;
+
+        for (j = 0; j < n; j++)
+        {
+            word |= (uint64_t)cells[64 * w + j] << j;
+        }
+        flips = key ? word : word ^ words[w];
+        words[w] = word;
+        while (flips != 0)
+        {
+            stream_run(&stream, index + 64 * w + __builtin_ctzll(flips), 1);
+            flips &= flips - 1;
+        }
+    }
+    stream_row_index++;
+}
+
+static void
+stream_generation(engine *eng, int generation)
+{
+    stream_begin(&stream, generation, stream_key_due(stream.last, generation, stream_key_every));
+    stream_row_index = 0;
+    eng->emit(stream_row);
+    stream_end(&stream);
+}
+
+// number of generations from iter up to and including the next one
+// where iter % every == every - 1, i.e. where something has to be printed
+static int
+gens_until(int iter, int every)
+{
+    return (every - 1 - iter % every + every) % every + 1;
+}
+
+static void
+usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-e auto|int|bits|blocked|active|hashlife|sparse] [-S density] [-t threads] [-k auto|scalar|sse2|avx2|avx512] [-b depth] [-M megabytes] [-G keep|drop|off] [-H ring] [-f] [-s seed] [-p probability] [-i pattern] [-z scale] [-F frames] [-o stream] [-K keyframes] rows cols steps worldstep cellstep\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int nsteps, opt;
+    double start_time, end_time, elapsed_time;
+    engine *eng = &engines[0];
+    const char *kernel = "auto";
+
+    /* Get Parameters */
+    while ((opt = getopt(argc, argv, "e:k:b:M:G:S:t:H:fs:p:i:z:F:o:K:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'e':
+            eng = find_engine(optarg);
+            if (eng == NULL)
+            {
+                fprintf(stderr, "unknown engine %s\n", optarg);
+                usage(argv[0]);
+            }
+            break;
+        case 'k':
+            kernel = optarg;
+            break;
+        case 'b':
+            block_depth = atoi(optarg);
+            if (block_depth < 1)
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+#ifdef _OPENMP
+            omp_set_num_threads(atoi(optarg));
+#else
+            fprintf(stderr, "built without OpenMP, -t is ignored\n");
+#endif
+            break;
+        case 'S':
+            sparse_threshold = atof(optarg);
+            break;
+        case 'H':
+            cycle_ring = atoi(optarg);
+            if (cycle_ring < 0)
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 'f':
+            fast_forward = 1;
+            break;
+        case 's':
+            rng_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            rng_density = atof(optarg);
+            break;
+        case 'i':
+            if (pattern_open(&start_pattern, optarg) != 0)
+            {
+                exit(1);
+            }
+            break;
+        case 'z':
+            render_scale = atoi(optarg);
+            if (render_scale < 1)
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 'F':
+            render_frames = optarg;
+            if (!render_frames_check(render_frames))
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 'o':
+            stream_file = optarg;
+            break;
+        case 'K':
+            stream_key_every = atoi(optarg);
+            if (stream_key_every < 1)
+            {
+                usage(argv[0]);
+            }
+            break;
+        case 'M':
+            hl_memory_cap = (size_t)atol(optarg) << 20;
+            break;
+        case 'G':
+            if (strcmp(optarg, "keep") == 0)
+            {
+                hl_gc_policy = HL_GC_KEEP;
+            }
+            else if (strcmp(optarg, "drop") == 0)
+            {
+                hl_gc_policy = HL_GC_DROP;
+            }
+            else if (strcmp(optarg, "off") == 0)
+            {
+                hl_gc_policy = HL_GC_OFF;
+            }
+            else
+            {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 5)
+    {
+        usage(argv[0]);
+    }
+    world_rows = atoi(argv[optind]);
+    world_cols = atoi(argv[optind + 1]);
+    nsteps = atoi(argv[optind + 2]);
+    print_world = atoi(argv[optind + 3]);
+    print_cells = atoi(argv[optind + 4]);
+    if (world_rows < 1 || world_cols < 1)
+    {
+        usage(argv[0]);
+    }
+
+    if (row_step_select(kernel) != 0)
+    {
+        exit(1);
+    }
+
+    row_cells = malloc(world_cols * sizeof(int));
+    if (row_cells == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    rng_init();
+    cycle_keys_init(world_rows, world_cols);
+    cycle_detector_init(&cycles, cycle_ring);
+    eng->init();
+    pattern_close(&start_pattern);
+
+    if (print_world > 0)
+    {
+        printf("\ninitial world:\n\n");
+        engine_print(eng);
+    }
+
+    if (stream_file != NULL)
+    {
+        stream_words = (world_cols + 63) / 64;
+        stream_world = malloc((size_t)world_rows * stream_words * sizeof(uint64_t));
+        if (stream_world == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        if (stream_create(&stream, stream_file, world_rows, world_cols, stream_key_every) != 0)
+        {
+            exit(1);
+        }
+        stream_generation(eng, 0);
+    }
+
+    start_time = time_secs();
+
+    /*  time steps, engines may advance several generations at once,
+     *  but never past a generation that has to be printed or recorded */
+    for (world_iter = 1; world_iter < nsteps; world_iter++)
+    {
+        int ngens, cycle = 0;
+
+        ngens = nsteps - world_iter;
+        if (print_cells > 0 && gens_until(world_iter, print_cells) < ngens)
+        {
+            ngens = gens_until(world_iter, print_cells);
+        }
+        if (print_world > 0 && gens_until(world_iter, print_world) < ngens)
+        {
+            ngens = gens_until(world_iter, print_world);
+        }
+        if (stream_file != NULL)
+        {
+            ngens = 1;
+        }
+
+        world_iter += eng->advance(world_iter, ngens, &cycle) - 1;
+
+        if (stream_file != NULL)
+        {
+            stream_generation(eng, world_iter);
+        }
+
+        if (print_cells > 0 && (world_iter % print_cells) == (print_cells - 1))
+        {
+            printf("%d: %d live cells\n", world_iter, eng->count());
+        }
+
+        if (print_world > 0 && (cycle || (world_iter % print_world) == (print_world - 1)))
+        {
+            printf("\nat time step %d:\n\n", world_iter);
+            engine_print(eng);
+        }
+
+        if (cycle && fast_forward)
+        {
+            int iter = world_iter + 1, left = (nsteps - 1 - world_iter) % cycle;
+
+            fprintf(stderr, "period %d, fast forward to generation %d replaying %d generations\n", cycle, nsteps - 1, left);
+            fast_forwarding = 1;
+            while (left > 0)
+            {
+                int ngens = eng->advance(iter, left, &cycle);
+
+                iter += ngens;
+                left -= ngens;
+            }
+            world_iter = nsteps - 1;
+
+            // the replayed generations are left out, the stream goes on with a keyframe
+            if (stream_file != NULL)
+            {
+                stream_generation(eng, world_iter);
+            }
+            if (print_world > 0)
+            {
+                printf("\nat time step %d:\n\n", world_iter);
+                engine_print(eng);
+            }
+        }
+
+        if (cycle)
+        {
+            break;
         }
     }
 
     end_time = time_secs();
     elapsed_time = end_time - start_time;
+
+    if (stream_file != NULL)
+    {
+        stream_close(&stream);
+    }
     
     /*  Iterations are done; sum the number of live cells */
-    printf("Number of live cells = %d\n", world_count(cur_world));
+    printf("Number of live cells = %d\n", eng->count());
     fprintf(stderr, "Game of Life took %10.3f seconds\n", elapsed_time);
+    fprintf(stderr, "step kernel: %s\n", row_step_name);
+#ifdef _OPENMP
+    fprintf(stderr, "threads: %d\n", omp_get_max_threads());
+#endif
+    if (eng->report != NULL)
+    {
+        eng->report();
+    }
 
     return 0;
 }
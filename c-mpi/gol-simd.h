@@ -0,0 +1,293 @@
+/***********************
+
+Explicitly vectorised Game of Life row kernels
+
+A row kernel computes the next state of n cells of one row from the rows
+above and below. All pointers point at the first interior cell, the kernel
+reads one ghost cell on each side (index -1 and index n).
+
+The kernel is chosen once at startup from what the CPU supports, so a single
+binary uses the widest vector unit of the node it runs on.
+
+************************/
+
+#ifndef GOL_SIMD_H
+#define GOL_SIMD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GOL_SIMD_X86
+#endif
+
+typedef void (*row_step_fn)(const int *up, const int *mid, const int *down, int *out, int n);
+
+// sum of the keys of the live cells among n cells, see gol-cycle.h
+typedef uint64_t (*row_sum_fn)(const uint32_t *keys, const int *cells, int n);
+
+static void
+row_step_scalar(const int *up, const int *mid, const int *down, int *out, int n)
+{
+    int col;
+
+    for (col = 0; col < n; col++)
+    {
+        int nsum, newval;
+
+        // sum surrounding cells
+        nsum = up[col - 1] + up[col] + up[col + 1] + mid[col - 1] + mid[col + 1] + down[col - 1] + down[col] + down[col + 1];
+
+        switch (nsum)
+        {
+        case 3:
+            // a new cell is born
+            newval = 1;
+            break;
+        case 2:
+            // the cell, if any, survives
+            newval = mid[col];
+            break;
+        default:
+            // the cell, if any, dies
+            newval = 0;
+            break;
+        }
+
+        out[col] = newval;
+    }
+}
+
+/* Row sums are accumulated in 32-bit lanes, which the compiler vectorises
+ * for the target of the function it is inlined into. With keys below 2^23 a
+ * chunk of 256 cells cannot overflow, so the sum is exact.
+ */
+static inline __attribute__((always_inline)) uint64_t
+row_sum_body(const uint32_t *keys, const int *cells, int n)
+{
+    uint64_t sum = 0;
+    int col, end, i;
+
+    for (col = 0; col < n; col = end)
+    {
+        uint32_t chunk = 0;
+
+        end = n - col > 256 ? col + 256 : n;
+        for (i = col; i < end; i++)
+        {
+            chunk += keys[i] & -(uint32_t)cells[i];
+        }
+        sum += chunk;
+    }
+
+    return sum;
+}
+
+static uint64_t
+row_sum_scalar(const uint32_t *keys, const int *cells, int n)
+{
+    return row_sum_body(keys, cells, n);
+}
+
+#ifdef GOL_SIMD_X86
+
+/* The vector kernels avoid the switch: with nsum excluding the cell itself,
+ * the cell lives in the next step exactly when (nsum | cell) == 3.
+ */
+
+__attribute__((target("sse2"))) static void
+row_step_sse2(const int *up, const int *mid, const int *down, int *out, int n)
+{
+    const __m128i three = _mm_set1_epi32(3);
+    const __m128i one = _mm_set1_epi32(1);
+    int col;
+
+    for (col = 0; col + 4 <= n; col += 4)
+    {
+        __m128i nsum, cell;
+
+        nsum = _mm_add_epi32(_mm_loadu_si128((const __m128i *)&up[col - 1]),
+                             _mm_loadu_si128((const __m128i *)&up[col]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&up[col + 1]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&mid[col - 1]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&mid[col + 1]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&down[col - 1]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&down[col]));
+        nsum = _mm_add_epi32(nsum, _mm_loadu_si128((const __m128i *)&down[col + 1]));
+        cell = _mm_loadu_si128((const __m128i *)&mid[col]);
+
+        _mm_storeu_si128((__m128i *)&out[col],
+                         _mm_and_si128(_mm_cmpeq_epi32(_mm_or_si128(nsum, cell), three), one));
+    }
+
+    row_step_scalar(up + col, mid + col, down + col, out + col, n - col);
+}
+
+__attribute__((target("avx2"))) static void
+row_step_avx2(const int *up, const int *mid, const int *down, int *out, int n)
+{
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i one = _mm256_set1_epi32(1);
+    int col;
+
+    for (col = 0; col + 8 <= n; col += 8)
+    {
+        __m256i nsum, cell;
+
+        nsum = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&up[col - 1]),
+                                _mm256_loadu_si256((const __m256i *)&up[col]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&up[col + 1]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&mid[col - 1]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&mid[col + 1]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&down[col - 1]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&down[col]));
+        nsum = _mm256_add_epi32(nsum, _mm256_loadu_si256((const __m256i *)&down[col + 1]));
+        cell = _mm256_loadu_si256((const __m256i *)&mid[col]);
+
+        _mm256_storeu_si256((__m256i *)&out[col],
+                            _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_or_si256(nsum, cell), three), one));
+    }
+
+    row_step_scalar(up + col, mid + col, down + col, out + col, n - col);
+}
+
+__attribute__((target("avx512f"))) static void
+row_step_avx512(const int *up, const int *mid, const int *down, int *out, int n)
+{
+    const __m512i three = _mm512_set1_epi32(3);
+    const __m512i one = _mm512_set1_epi32(1);
+    int col;
+
+    // the tail is handled with masked loads and stores instead of scalar code
+    for (col = 0; col < n; col += 16)
+    {
+        __mmask16 m = n - col >= 16 ? 0xffff : (__mmask16)((1u << (n - col)) - 1);
+        __m512i nsum, cell;
+
+        nsum = _mm512_add_epi32(_mm512_maskz_loadu_epi32(m, &up[col - 1]),
+                                _mm512_maskz_loadu_epi32(m, &up[col]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &up[col + 1]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &mid[col - 1]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &mid[col + 1]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &down[col - 1]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &down[col]));
+        nsum = _mm512_add_epi32(nsum, _mm512_maskz_loadu_epi32(m, &down[col + 1]));
+        cell = _mm512_maskz_loadu_epi32(m, &mid[col]);
+
+        _mm512_mask_storeu_epi32(&out[col], m,
+                                 _mm512_maskz_mov_epi32(_mm512_cmpeq_epi32_mask(_mm512_or_si512(nsum, cell), three), one));
+    }
+}
+
+__attribute__((target("avx2"))) static uint64_t
+row_sum_avx2(const uint32_t *keys, const int *cells, int n)
+{
+    return row_sum_body(keys, cells, n);
+}
+
+__attribute__((target("avx512f"))) static uint64_t
+row_sum_avx512(const uint32_t *keys, const int *cells, int n)
+{
+    return row_sum_body(keys, cells, n);
+}
+
+#endif
+
+// number of live cells among n cells, plain enough for the compiler to vectorise
+static inline int
+row_count(const int *cells, int n)
+{
+    int col, live = 0;
+
+    for (col = 0; col < n; col++)
+    {
+        live += cells[col];
+    }
+
+    return live;
+}
+
+typedef struct
+{
+    const char *name;
+    row_step_fn fn;
+    row_sum_fn sum;
+    const char *feature; // CPU feature that has to be present, NULL if none
+} row_step_kernel;
+
+// widest first, so "auto" picks the first supported one
+static const row_step_kernel row_step_kernels[] = {
+#ifdef GOL_SIMD_X86
+    {"avx512", row_step_avx512, row_sum_avx512, "avx512f"},
+    {"avx2", row_step_avx2, row_sum_avx2, "avx2"},
+    {"sse2", row_step_sse2, row_sum_scalar, "sse2"},
+#endif
+    {"scalar", row_step_scalar, row_sum_scalar, NULL},
+};
+
+static row_step_fn row_step = row_step_scalar;
+static row_sum_fn row_sum = row_sum_scalar;
+static const char *row_step_name = "scalar";
+
+static int
+row_step_supported(const row_step_kernel *kernel)
+{
+    if (kernel->feature == NULL)
+    {
+        return 1;
+    }
+#ifdef GOL_SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(kernel->feature, "avx512f") == 0)
+    {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (strcmp(kernel->feature, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernel->feature, "sse2") == 0)
+    {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return 0;
+}
+
+// select the row kernel by name, or the widest supported one for "auto"
+// returns 0 on success, -1 if the kernel is unknown or not supported here
+static int
+row_step_select(const char *name)
+{
+    int k;
+
+    for (k = 0; k < sizeof(row_step_kernels) / sizeof(row_step_kernel); k++)
+    {
+        const row_step_kernel *kernel = &row_step_kernels[k];
+
+        if (strcmp(name, "auto") != 0 && strcmp(name, kernel->name) != 0)
+        {
+            continue;
+        }
+        if (!row_step_supported(kernel))
+        {
+            if (strcmp(name, "auto") == 0)
+            {
+                continue;
+            }
+            fprintf(stderr, "step kernel %s is not supported on this CPU\n", name);
+            return -1;
+        }
+        row_step = kernel->fn;
+        row_sum = kernel->sum;
+        row_step_name = kernel->name;
+        return 0;
+    }
+
+    fprintf(stderr, "unknown step kernel %s\n", name);
+    return -1;
+}
+
+#endif
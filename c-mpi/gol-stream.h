@@ -0,0 +1,475 @@
+/***********************
+
+Frame streams
+
+A stream file records a run generation by generation, in the byte order of
+the machine:
+
+- a stream_header
+- one record per generation: a stream_record and size bytes of payload. The
+  payload of a keyframe lists the runs of live cells, the one of a delta the
+  runs of cells that flipped since the generation before it. Cell (row, col)
+  has the index (row - 1) * cols + col - 1, a run is the varint of the gap
+  from the end of the run before it (from 0 for the first) and the varint of
+  its length, runs come in increasing order.
+- when the run finished, an index record, whose payload holds the generation
+  and file offset of every keyframe as stream_keys, and a stream_trailer
+
+Keyframes are written every key_every generations, for the first generation
+and after a gap in the generations, as fast forwarding makes one. The file is
+flushed after every keyframe, so a run that was killed leaves a stream that
+is good up to its last keyframe; its index is rebuilt by skipping from record
+to record. A delta costs a few bytes per run of flipped cells, so the stream
+grows with the activity of the world rather than with its size.
+
+A reader seeks to a generation by loading the last keyframe at or before it
+and applying the deltas after that keyframe. The programs that record get the
+writer, gol-replay defines STREAM_READER before the include to get the reader.
+
+************************/
+
+#ifndef GOL_STREAM_H
+#define GOL_STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define STREAM_MAGIC "GOLSTRM1"
+#define STREAM_INDEX_MAGIC "GOLSIDX1"
+
+enum
+{
+    STREAM_KEY,
+    STREAM_DELTA,
+    STREAM_INDEX
+};
+
+typedef struct
+{
+    char magic[8];
+    int32_t rows, cols;
+    int32_t key_every;
+    int32_t reserved;
+} stream_header;
+
+typedef struct
+{
+    int32_t generation;
+    int32_t kind; // STREAM_KEY, STREAM_DELTA or STREAM_INDEX
+    int64_t size; // bytes of payload that follow
+} stream_record;
+
+typedef struct
+{
+    int32_t generation;
+    int32_t reserved;
+    int64_t offset; // of the stream_record
+} stream_key;
+
+typedef struct
+{
+    int64_t index_offset; // of the index record
+    char magic[8];
+} stream_trailer;
+
+// does generation need a keyframe, after generation last was recorded (-1 for none)?
+static inline int
+stream_key_due(int last, int generation, int key_every)
+{
+    return last < 0 || generation != last + 1 || (key_every > 0 && generation % key_every == 0);
+}
+
+static void
+stream_grow(void **p, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+    {
+        return;
+    }
+    *capacity = needed > 2 * *capacity ? needed : 2 * *capacity;
+    *p = realloc(*p, *capacity * size);
+    if (*p == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+#ifndef STREAM_READER
+
+/***********************
+ * writing
+ ***********************/
+
+typedef struct
+{
+    FILE *file;
+    int key_every;
+    int last; // generation of the last record, -1 if none
+
+    stream_key *keys;
+    size_t nkeys, keys_capacity;
+
+    // the record being encoded
+    stream_record record;
+    unsigned char *payload;
+    size_t payload_capacity;
+    uint64_t run_start, run_end; // run not encoded yet, empty if equal
+    uint64_t encoded_end;        // end of the last encoded run
+} stream_writer;
+
+// create the stream file, returns -1 with a message on errors
+static int
+stream_create(stream_writer *w, const char *path, int rows, int cols, int key_every)
+{
+    stream_header header;
+
+    memset(w, 0, sizeof(*w));
+    w->file = fopen(path, "wb");
+    if (w->file == NULL)
+    {
+        fprintf(stderr, "cannot create stream %s\n", path);
+        return -1;
+    }
+    w->key_every = key_every;
+    w->last = -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_MAGIC, 8);
+    header.rows = rows;
+    header.cols = cols;
+    header.key_every = key_every;
+    fwrite(&header, sizeof(header), 1, w->file);
+
+    return 0;
+}
+
+// start the record of generation, a keyframe if key
+static void
+stream_begin(stream_writer *w, int generation, int key)
+{
+    w->record.generation = generation;
+    w->record.kind = key ? STREAM_KEY : STREAM_DELTA;
+    w->record.size = 0;
+    w->run_start = w->run_end = 0;
+    w->encoded_end = 0;
+}
+
+static void
+stream_varint(stream_writer *w, uint64_t v)
+{
+    stream_grow((void **)&w->payload, &w->payload_capacity, w->record.size + 10, 1);
+    while (v >= 0x80)
+    {
+        w->payload[w->record.size++] = (unsigned char)v | 0x80;
+        v >>= 7;
+    }
+    w->payload[w->record.size++] = (unsigned char)v;
+}
+
+static void
+stream_flush_run(stream_writer *w)
+{
+    if (w->run_end == w->run_start)
+    {
+        return;
+    }
+    stream_varint(w, w->run_start - w->encoded_end);
+    stream_varint(w, w->run_end - w->run_start);
+    w->encoded_end = w->run_end;
+    w->run_start = w->run_end;
+}
+
+// add length cells from index start on, after the runs added before;
+// runs that touch are merged
+static void
+stream_run(stream_writer *w, uint64_t start, uint64_t length)
+{
+    if (start != w->run_end || w->run_end == w->run_start)
+    {
+        stream_flush_run(w);
+        w->run_start = start;
+    }
+    w->run_end = start + length;
+}
+
+// write the record out
+static void
+stream_end(stream_writer *w)
+{
+    stream_flush_run(w);
+
+    if (w->record.kind == STREAM_KEY)
+    {
+        stream_grow((void **)&w->keys, &w->keys_capacity, w->nkeys + 1, sizeof(stream_key));
+        w->keys[w->nkeys].generation = w->record.generation;
+        w->keys[w->nkeys].reserved = 0;
+        w->keys[w->nkeys].offset = ftello(w->file);
+        w->nkeys++;
+    }
+    fwrite(&w->record, sizeof(w->record), 1, w->file);
+    fwrite(w->payload, 1, w->record.size, w->file);
+    if (w->record.kind == STREAM_KEY)
+    {
+        fflush(w->file);
+    }
+    w->last = w->record.generation;
+}
+
+// write the index and close the file
+static void
+stream_close(stream_writer *w)
+{
+    stream_record record;
+    stream_trailer trailer;
+
+    record.generation = w->last;
+    record.kind = STREAM_INDEX;
+    record.size = w->nkeys * sizeof(stream_key);
+    trailer.index_offset = ftello(w->file);
+    memcpy(trailer.magic, STREAM_INDEX_MAGIC, 8);
+
+    fwrite(&record, sizeof(record), 1, w->file);
+    fwrite(w->keys, sizeof(stream_key), w->nkeys, w->file);
+    fwrite(&trailer, sizeof(trailer), 1, w->file);
+    if (fclose(w->file) != 0)
+    {
+        fprintf(stderr, "cannot write stream\n");
+    }
+
+    free(w->keys);
+    free(w->payload);
+    w->file = NULL;
+}
+
+#else
+
+/***********************
+ * reading
+ ***********************/
+
+typedef struct
+{
+    FILE *file;
+    stream_header header;
+    stream_key *keys;
+    size_t nkeys, keys_capacity;
+
+    unsigned char *cells; // rows * cols cells, 0 or 1
+    int generation;       // of the cells, -1 before the first record
+
+    unsigned char *payload;
+    size_t payload_capacity;
+} stream_reader;
+
+// read the header of the record at the file position, returns 0 at the end
+// of the records, also for a record that was cut short
+static int
+stream_read_record(stream_reader *r, stream_record *record)
+{
+    return fread(record, sizeof(*record), 1, r->file) == 1 && record->kind != STREAM_INDEX && record->size >= 0;
+}
+
+// the index of a stream that was not closed, by skipping from record to record
+static void
+stream_scan_keys(stream_reader *r)
+{
+    stream_record record;
+    off_t offset = sizeof(stream_header);
+
+    fseeko(r->file, offset, SEEK_SET);
+    r->nkeys = 0;
+    while (stream_read_record(r, &record))
+    {
+        if (record.kind == STREAM_KEY)
+        {
+            stream_grow((void **)&r->keys, &r->keys_capacity, r->nkeys + 1, sizeof(stream_key));
+            r->keys[r->nkeys].generation = record.generation;
+            r->keys[r->nkeys].offset = offset;
+            r->nkeys++;
+        }
+        offset += sizeof(record) + record.size;
+        if (fseeko(r->file, offset, SEEK_SET) != 0)
+        {
+            break;
+        }
+    }
+}
+
+// open a stream and load its index, returns -1 with a message on errors
+static int
+stream_open(stream_reader *r, const char *path)
+{
+    stream_trailer trailer;
+    stream_record record;
+
+    memset(r, 0, sizeof(*r));
+    r->generation = -1;
+    r->file = fopen(path, "rb");
+    if (r->file == NULL)
+    {
+        fprintf(stderr, "cannot open stream %s\n", path);
+        return -1;
+    }
+    if (fread(&r->header, sizeof(r->header), 1, r->file) != 1 || memcmp(r->header.magic, STREAM_MAGIC, 8) != 0 ||
+        r->header.rows < 1 || r->header.cols < 1)
+    {
+        fprintf(stderr, "%s is not a stream\n", path);
+        fclose(r->file);
+        return -1;
+    }
+    r->cells = calloc((size_t)r->header.rows * r->header.cols, 1);
+    if (r->cells == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    if (fseeko(r->file, -(off_t)sizeof(trailer), SEEK_END) == 0 && fread(&trailer, sizeof(trailer), 1, r->file) == 1 &&
+        memcmp(trailer.magic, STREAM_INDEX_MAGIC, 8) == 0 && fseeko(r->file, trailer.index_offset, SEEK_SET) == 0 &&
+        fread(&record, sizeof(record), 1, r->file) == 1 && record.kind == STREAM_INDEX)
+    {
+        r->nkeys = record.size / sizeof(stream_key);
+        stream_grow((void **)&r->keys, &r->keys_capacity, r->nkeys + 1, sizeof(stream_key));
+        if (fread(r->keys, sizeof(stream_key), r->nkeys, r->file) != r->nkeys)
+        {
+            stream_scan_keys(r);
+        }
+    }
+    else
+    {
+        stream_scan_keys(r);
+    }
+    if (r->nkeys == 0)
+    {
+        fprintf(stderr, "stream %s has no keyframes\n", path);
+        fclose(r->file);
+        return -1;
+    }
+
+    fseeko(r->file, r->keys[0].offset, SEEK_SET);
+    return 0;
+}
+
+static int
+stream_read_varint(const unsigned char **pp, const unsigned char *end, uint64_t *v)
+{
+    const unsigned char *p = *pp;
+    int shift = 0;
+
+    *v = 0;
+    while (p < end && shift < 64)
+    {
+        *v |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+        {
+            *pp = p;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+// read the record at the file position and apply it to the cells, returns 0
+// at the end of the stream or on a broken record
+static int
+stream_next(stream_reader *r)
+{
+    uint64_t ncells = (uint64_t)r->header.rows * r->header.cols, pos = 0, gap, length, i;
+    const unsigned char *p, *end;
+    stream_record record;
+
+    if (!stream_read_record(r, &record))
+    {
+        return 0;
+    }
+    stream_grow((void **)&r->payload, &r->payload_capacity, record.size, 1);
+    if (fread(r->payload, 1, record.size, r->file) != (size_t)record.size)
+    {
+        return 0;
+    }
+
+    if (record.kind == STREAM_KEY)
+    {
+        memset(r->cells, 0, ncells);
+    }
+    for (p = r->payload, end = p + record.size; p < end; pos += length)
+    {
+        if (!stream_read_varint(&p, end, &gap) || !stream_read_varint(&p, end, &length) ||
+            gap > ncells - pos || length > ncells - pos - gap)
+        {
+            fprintf(stderr, "broken record of generation %d\n", record.generation);
+            return 0;
+        }
+        pos += gap;
+        if (record.kind == STREAM_KEY)
+        {
+            memset(&r->cells[pos], 1, length);
+        }
+        else
+        {
+            for (i = pos; i < pos + length; i++)
+            {
+                r->cells[i] ^= 1;
+            }
+        }
+    }
+    r->generation = record.generation;
+
+    return 1;
+}
+
+// go to the first generation at or after generation that the stream has,
+// returns 0 if there is none
+static int
+stream_seek(stream_reader *r, int generation)
+{
+    size_t lo = 0, hi = r->nkeys;
+
+    // the last keyframe at or before generation, or the first one
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+
+        if (r->keys[mid].generation <= generation)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    fseeko(r->file, r->keys[lo].offset, SEEK_SET);
+    if (!stream_next(r))
+    {
+        return 0;
+    }
+
+    while (r->generation < generation)
+    {
+        if (!stream_next(r))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void
+stream_close_reader(stream_reader *r)
+{
+    fclose(r->file);
+    free(r->keys);
+    free(r->cells);
+    free(r->payload);
+}
+
+#endif
+
+#endif
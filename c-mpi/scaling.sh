@@ -0,0 +1,39 @@
+#!/bin/sh
+# Thread-count scaling report for gol-seq
+#
+# Usage: ./scaling.sh rows cols steps [max_threads [engine]]
+#
+# Runs the same world with 1, 2, 4, ... threads up to max_threads (default:
+# number of cores) and prints time, speedup and parallel efficiency. Threads
+# are spread over the sockets and pinned, so first-touch allocation places
+# every row band on the socket of the thread that computes it.
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 rows cols steps [max_threads [engine]]" >&2
+    exit 1
+fi
+
+rows=$1
+cols=$2
+steps=$3
+max=${4:-$(nproc)}
+engine=${5:-int}
+
+export OMP_PROC_BIND=${OMP_PROC_BIND:-spread}
+export OMP_PLACES=${OMP_PLACES:-cores}
+
+printf "%8s %12s %10s %12s\n" threads seconds speedup efficiency
+t=1
+base=
+while [ "$t" -le "$max" ]; do
+    secs=$(./gol-seq -e "$engine" -t "$t" "$rows" "$cols" "$steps" 0 0 2>&1 >/dev/null |
+        sed -n 's/Game of Life took *\([0-9.]*\) seconds/\1/p')
+    base=${base:-$secs}
+    awk -v t="$t" -v s="$secs" -v b="$base" \
+        'BEGIN { printf "%8d %12.3f %10.2f %11.0f%%\n", t, s, b / s, 100 * b / s / t }'
+    if [ "$t" -lt "$max" ] && [ $((t * 2)) -gt "$max" ]; then
+        t=$max
+    else
+        t=$((t * 2))
+    fi
+done
@@ -40,8 +40,8 @@ function block()
     [(2, 2), (2, 3), (3, 2), (3, 3)]
 end
 
-function game_serial(init_fun, m, n, steps, worldstep, irun=1)
-    params = (; init_fun, m, n, steps, worldstep, irun)
+function game_serial(init_fun, m, n, steps, worldstep, irun=1; fast_forward=false)
+    params = (; init_fun, m, n, steps, worldstep, irun, fast_forward)
     fn = "serial_$(nameof(init_fun))_$(m)_$(n)_$(steps)_$(worldstep)_run_$irun"
     if worldstep == 0 # No animation
         game_serial_impl(nothing, fn, params)
@@ -68,6 +68,9 @@ end
 
 function game_serial_impl(chnl_anim, fn, params)
     (; init_fun, m, n, steps, worldstep, irun) = params
+    # with fast_forward a cycle does not end the run, only the remaining
+    # steps modulo the period are replayed to reach the state at steps
+    fast_forward = get(params, :fast_forward, false)
     a = Matrix{Int32}(undef, m + 2, n + 2)
     initial_coords = init_fun()
     init!(initial_coords, a, 1:m, 1:n)
@@ -85,8 +88,16 @@ function game_serial_impl(chnl_anim, fn, params)
         if worldstep != 0 && (istep % worldstep) == 0
             put!(chnl_anim, a[2:end-1, 2:end-1])
         end
-        if has_cycled(a, a_history, istep)
+        period = cycle_period(a, a_history, istep)
+        if period != 0
             final_step = istep
+            if fast_forward
+                for _ in 1:mod(steps - istep, period)
+                    step_serial!(a_new, a)
+                    a, a_new = a_new, a
+                end
+                final_step = steps
+            end
             break
         end
     end
@@ -199,8 +210,14 @@ function sum_interior_cells(a)
 end
 
 function has_cycled(a, a_history, istep)
-    r1 = interior_cells_are_equal(a, a_history[1])
-    r1 || (istep > 1 && interior_cells_are_equal(a, a_history[2]))
+    cycle_period(a, a_history, istep) != 0
+end
+
+# period of the cycle a is in, 0 if it repeats none of the last two states
+function cycle_period(a, a_history, istep)
+    interior_cells_are_equal(a, a_history[1]) && return 1
+    istep > 1 && interior_cells_are_equal(a, a_history[2]) && return 2
+    return 0
 end
 
 function interior_cells_are_equal(a, b)